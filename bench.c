@@ -0,0 +1,1269 @@
+/*
+** BoxWorld Copyright 2016(c) Wael El Oraiby. All Rights Reserved
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** Under Section 7 of GPL version 3, you are granted additional
+** permissions described in the GCC Runtime Library Exception, version
+** 3.1, as published by the Free Software Foundation.
+**
+** You should have received a copy of the GNU General Public License and
+** a copy of the GCC Runtime Library Exception along with this program;
+** see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+** <http://www.gnu.org/licenses/>.
+**
+*/
+#include "boxworld.h"
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * headless benchmarks, run as: cBoxWorldBench <name> [args...]
+ */
+
+static const char*	sample_level =
+	"    #####\n"
+	"    #   #\n"
+	"    #$  #\n"
+	"  ###  $##\n"
+	"  #  $ $ #\n"
+	"### # ## #   ######\n"
+	"#   # ## #####  ..#\n"
+	"# $  $          ..#\n"
+	"##### ### #@##  ..#\n"
+	"    #     #########\n"
+	"    #######\n";
+
+/* synthesized pack used when no file is given */
+static char*
+make_sample_pack(uint32 level_count, size_t* size) {
+	size_t		level_len	= strlen(sample_level);
+	size_t		title_max	= 32;
+	char*		text		= (char*)malloc((level_len + title_max) * level_count + 1);
+	size_t		len			= 0;
+	uint32		l;
+
+	assert( NULL != text );
+
+	for( l = 0; l < level_count; ++l ) {
+		len	+= (size_t)sprintf(text + len, "; %u\n\n", l + 1);
+		memcpy(text + len, sample_level, level_len);
+		len	+= level_len;
+		text[len++]	= '\n';
+	}
+
+	text[len]	= '\0';
+	*size		= len;
+	return text;
+}
+
+static int
+bench_parse(int argc, char** argv) {
+	const char*		path		= argc > 0 ? argv[0] : NULL;
+	uint32			iterations	= argc > 1 ? (uint32)atoi(argv[1]) : 10;
+	uint32			levels		= 0;
+	size_t			bytes		= 0;
+	double			start, elapsed;
+	uint32			i;
+	char*			text		= NULL;
+
+	if( NULL == path || 0 == strcmp(path, "-") ) {
+		text	= make_sample_pack(10000, &bytes);
+	}
+
+	start	= boxworld_seconds();
+	for( i = 0; i < iterations; ++i ) {
+		level_collection_t*	coll;
+
+		if( text ) {
+			coll	= level_collection_parse(text, bytes);
+		} else {
+			FILE*	f	= fopen(path, "rb");
+			if( f ) {
+				fseek(f, 0, SEEK_END);
+				bytes	= (size_t)ftell(f);
+				fclose(f);
+			}
+			coll	= level_collection_load(path);
+		}
+
+		if( NULL == coll ) {
+			fprintf(stderr, "parse: %s\n", boxworld_error_string());
+			free(text);
+			return EXIT_FAILURE;
+		}
+
+		levels	= coll->count;
+		level_collection_release(coll);
+	}
+	elapsed	= boxworld_seconds() - start;
+
+	printf("parse: %u levels, %.2f MB, %u iterations, %.3f s\n", levels, (double)bytes / (1024.0 * 1024.0), iterations, elapsed);
+	printf("parse: %.0f levels/s, %.2f MB/s\n",
+		   (double)levels * iterations / elapsed,
+		   (double)bytes * iterations / (1024.0 * 1024.0) / elapsed);
+
+	free(text);
+	return EXIT_SUCCESS;
+}
+
+static int
+bench_levelpack(int argc, char** argv) {
+	uint32			lookups	= argc > 1 ? (uint32)atoi(argv[1]) : 1000000;
+	levelpack_t*	pack;
+	level_t			lvl		= { 0, 0, NULL };
+	double			start, open_time, elapsed;
+	uint32			i, index	= 0;
+
+	if( argc < 1 ) {
+		fprintf(stderr, "levelpack: missing pack file\n");
+		return EXIT_FAILURE;
+	}
+
+	start	= boxworld_seconds();
+	pack	= levelpack_open(argv[0]);
+	if( NULL == pack || 0 == pack->count ) {
+		fprintf(stderr, "levelpack: %s\n", pack ? "empty pack" : boxworld_error_string());
+		return EXIT_FAILURE;
+	}
+	open_time	= boxworld_seconds() - start;
+
+	/* random level switches */
+	start	= boxworld_seconds();
+	for( i = 0; i < lookups; ++i ) {
+		index	= (index * 1103515245u + 12345u) % pack->count;
+		if( !levelpack_level(pack, index, &lvl) ) {
+			fprintf(stderr, "levelpack: %s\n", boxworld_error_string());
+			break;
+		}
+	}
+	elapsed	= boxworld_seconds() - start;
+
+	printf("levelpack: %u levels, open %.3f ms\n", pack->count, open_time * 1000.0);
+	printf("levelpack: %u random switches, %.3f us/switch\n", i, elapsed * 1e6 / MAX(i, 1));
+
+	level_release(&lvl);
+	levelpack_close(pack);
+	return EXIT_SUCCESS;
+}
+
+/* the biggest level a board holds: an open room with a few boxes scattered around */
+static char*
+make_big_level(size_t* size) {
+	uint32		w		= BOARD_MAX_WIDTH;
+	uint32		h		= BOARD_MAX_HEIGHT;
+	char*		text	= (char*)malloc((w + 1) * h + 1);
+	uint32		x, y;
+	size_t		len		= 0;
+
+	assert( NULL != text );
+
+	for( y = 0; y < h; ++y ) {
+		for( x = 0; x < w; ++x ) {
+			char	c	= ' ';
+			if( 0 == x || 0 == y || w - 1 == x || h - 1 == y ) {
+				c	= '#';
+			} else if( x % 7 == 3 && x + 1 < w - 1 && y % 6 == 3 ) {
+				c	= '$';
+			} else if( x % 7 == 4 && y % 6 == 3 ) {
+				c	= '.';
+			} else if( x % 8 == 0 && y % 5 == 0 ) {
+				c	= '#';
+			} else if( 1 == x && 1 == y ) {
+				c	= '@';
+			}
+			text[len++]	= c;
+		}
+		text[len++]	= '\n';
+	}
+
+	text[len]	= '\0';
+	*size		= len;
+	return text;
+}
+
+static int
+bench_board(int argc, char** argv) {
+	const char*			path		= argc > 0 ? argv[0] : NULL;
+	uint32				iterations	= argc > 1 ? (uint32)atoi(argv[1]) : 100;
+	level_collection_t*	coll;
+	double				worst		= 0.0;
+	double				total		= 0.0;
+	uint32				worst_level	= 0;
+	uint32				loaded		= 0;
+	uint32				l, i;
+
+	if( NULL == path || 0 == strcmp(path, "-") ) {
+		size_t	size;
+		char*	text	= make_big_level(&size);
+		coll	= level_collection_parse(text, size);
+		free(text);
+	} else {
+		coll	= level_collection_load(path);
+	}
+
+	if( NULL == coll ) {
+		fprintf(stderr, "board: %s\n", boxworld_error_string());
+		return EXIT_FAILURE;
+	}
+
+	for( l = 0; l < coll->count; ++l ) {
+		double	start	= boxworld_seconds();
+		double	elapsed;
+		bool	ok		= true;
+
+		for( i = 0; i < iterations && ok; ++i ) {
+			board_t	b;
+			ok	= board_from_level(&b, &(coll->levels[l]));
+			if( ok ) {
+				board_release(&b);
+			}
+		}
+
+		if( !ok ) {
+			continue;
+		}
+
+		elapsed	= (boxworld_seconds() - start) / iterations;
+		total	+= elapsed;
+		++loaded;
+		if( elapsed > worst ) {
+			worst		= elapsed;
+			worst_level	= l;
+		}
+	}
+
+	printf("board: %u levels, %.3f us/level average\n", loaded, total * 1e6 / MAX(loaded, 1));
+	printf("board: worst level %u (%ux%u), %.3f us\n", worst_level + 1,
+		   coll->count ? coll->levels[worst_level].width : 0, coll->count ? coll->levels[worst_level].height : 0,
+		   worst * 1e6);
+
+	level_collection_release(coll);
+	return EXIT_SUCCESS;
+}
+
+/* collection from a file, or the sample level when the path is NULL or "-" */
+static level_collection_t*
+load_levels(const char* path) {
+	level_collection_t*	coll;
+
+	if( NULL == path || 0 == strcmp(path, "-") ) {
+		coll	= level_collection_parse(sample_level, strlen(sample_level));
+	} else {
+		coll	= level_collection_load(path);
+	}
+
+	if( NULL == coll ) {
+		fprintf(stderr, "unable to load levels: %s\n", boxworld_error_string());
+	}
+	return coll;
+}
+
+static int
+bench_solve(int argc, char** argv) {
+	level_collection_t*	coll	= load_levels(argc > 0 ? argv[0] : NULL);
+	uint32				first	= argc > 1 ? (uint32)atoi(argv[1]) : 0;
+	uint32				count	= argc > 2 ? (uint32)atoi(argv[2]) : 1;
+	solver_params_t		params	= solver_default_params();
+	key_array_t			keys	= key_array_new();
+	uint64				expanded	= 0;
+	double				elapsed		= 0.0;
+	uint32				l;
+
+	if( NULL == coll ) {
+		return EXIT_FAILURE;
+	}
+
+	if( argc > 3 ) {
+		params.memory_budget	= (size_t)atoi(argv[3]) << 20;
+	}
+
+	if( argc > 4 && atoi(argv[4]) ) {
+		params.deadlocks	= deadlock_cache_create(1 << 20);
+	}
+
+	for( l = first; l < first + count && l < coll->count; ++l ) {
+		solver_stats_t	st;
+
+		solver_solve(&(coll->levels[l]), &params, &keys, &st);
+		printf("solve: level %u: %s, %u pushes, %u moves, %llu nodes, %.3f s, %.1f MB\n",
+			   l + 1, solver_result_string(st.result), st.pushes,
+			   st.result == SOLVER_SOLVED ? (uint32)keys.count : 0,
+			   (unsigned long long)st.expanded, st.elapsed, (double)st.memory_used / (1024.0 * 1024.0));
+
+		expanded	+= st.expanded;
+		elapsed		+= st.elapsed;
+	}
+
+	printf("solve: %.0f nodes/s\n", (double)expanded / MAX(elapsed, 1e-9));
+
+	key_array_release(&keys);
+	deadlock_cache_release(params.deadlocks);
+	level_collection_release(coll);
+	return EXIT_SUCCESS;
+}
+
+static int
+bench_psolve(int argc, char** argv) {
+	level_collection_t*	coll	= load_levels(argc > 0 ? argv[0] : NULL);
+	uint32				index	= argc > 1 ? (uint32)atoi(argv[1]) : 0;
+	uint32				threads	= argc > 2 ? (uint32)atoi(argv[2]) : (uint32)sysconf(_SC_NPROCESSORS_ONLN);
+	solver_params_t		params	= solver_default_params();
+	key_array_t			keys	= key_array_new();
+	solver_stats_t		st[2];
+	uint32				run_threads[2];
+	uint32				r;
+
+	if( NULL == coll ) {
+		return EXIT_FAILURE;
+	}
+
+	if( index >= coll->count ) {
+		fprintf(stderr, "psolve: no level %u\n", index);
+		key_array_release(&keys);
+		level_collection_release(coll);
+		return EXIT_FAILURE;
+	}
+
+	run_threads[0]	= 1;
+	run_threads[1]	= MAX(threads, 1);
+
+	for( r = 0; r < 2; ++r ) {
+		psolver_solve(&(coll->levels[index]), &params, run_threads[r], &keys, &(st[r]));
+		printf("psolve: %u thread(s): %s, %u pushes, %u moves, %llu nodes, %.3f s, %.0f nodes/s\n",
+			   run_threads[r], solver_result_string(st[r].result), st[r].pushes,
+			   st[r].result == SOLVER_SOLVED ? (uint32)keys.count : 0,
+			   (unsigned long long)st[r].expanded, st[r].elapsed,
+			   (double)st[r].expanded / MAX(st[r].elapsed, 1e-9));
+	}
+
+	printf("psolve: speedup %.2fx on %u threads\n", st[0].elapsed / MAX(st[1].elapsed, 1e-9), run_threads[1]);
+
+	key_array_release(&keys);
+	level_collection_release(coll);
+	return EXIT_SUCCESS;
+}
+
+/*
+ * random play on each level: times the incremental lower bound update per
+ * push and checks it against a full recomputation
+ */
+static int
+bench_bound(int argc, char** argv) {
+	level_collection_t*	coll	= load_levels(argc > 0 ? argv[0] : NULL);
+	uint32				moves	= argc > 1 ? (uint32)atoi(argv[1]) : 100000;
+	lower_bound_t		check;
+	uint64				pushes	= 0;
+	uint32				wrong	= 0;
+	uint32				seed	= 1;
+	double				incremental	= 0.0;
+	double				full		= 0.0;
+	uint32				l, m;
+
+	if( NULL == coll ) {
+		return EXIT_FAILURE;
+	}
+
+	for( l = 0; l < coll->count; ++l ) {
+		game_state_t	state;
+
+		if( !game_init(&state, &(coll->levels[l]), l) ) {
+			continue;
+		}
+
+		if( !lower_bound_init(&check, &(state.board)) ) {
+			game_release(&state);
+			continue;
+		}
+
+		for( m = 0; m < moves; ++m ) {
+			double	start	= boxworld_seconds();
+
+			seed	= seed * 1103515245u + 12345u;
+			game_next_state(&state, (KEY)((seed >> 16) & 3));
+			if( !(state.last_move & MOVE_PUSH) ) {
+				continue;
+			}
+			incremental	+= boxworld_seconds() - start;
+			++pushes;
+
+			start	= boxworld_seconds();
+			lower_bound_reset(&check, &(state.board));
+			full	+= boxworld_seconds() - start;
+
+			wrong	+= check.value != state.bound.value;
+		}
+
+		lower_bound_release(&check);
+		game_release(&state);
+	}
+
+	printf("bound: %llu pushes, %.3f us/push incremental, %.3f us/push full\n",
+		   (unsigned long long)pushes, incremental * 1e6 / MAX(pushes, 1), full * 1e6 / MAX(pushes, 1));
+	printf("bound: %u mismatches\n", wrong);
+
+	level_collection_release(coll);
+	return wrong ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* random play timing game_next_state, with the state hash checked against a full recomputation */
+static int
+bench_hash(int argc, char** argv) {
+	level_collection_t*	coll	= load_levels(argc > 0 ? argv[0] : NULL);
+	uint32				moves	= argc > 1 ? (uint32)atoi(argv[1]) : 100000;
+	uint64				reach[BOARD_MAX_HEIGHT];
+	uint32				wrong	= 0;
+	uint32				l, m, mode;
+
+	if( NULL == coll ) {
+		return EXIT_FAILURE;
+	}
+
+	for( mode = 0; mode < 2; ++mode ) {
+		uint64	played	= 0;
+		uint32	seed	= 1;
+		double	elapsed	= 0.0;
+
+		for( l = 0; l < coll->count; ++l ) {
+			game_state_t	state;
+			double			start;
+
+			if( !game_init(&state, &(coll->levels[l]), l) ) {
+				continue;
+			}
+			game_hash_normalize(&state, mode != 0);
+
+			start	= boxworld_seconds();
+			for( m = 0; m < moves; ++m ) {
+				seed	= seed * 1103515245u + 12345u;
+				game_next_state(&state, (KEY)((seed >> 16) & 3));
+			}
+			elapsed	+= boxworld_seconds() - start;
+			played	+= moves;
+
+			/* the whole walk must land on the hash of the final position */
+			wrong	+= state.hash != (board_boxes_hash(&(state.board)) ^
+									  zobrist_key(ZOBRIST_PLAYER, mode ? board_reachable(&(state.board), state.board.player, reach) : state.board.player));
+			game_release(&state);
+		}
+
+		printf("hash: %s, %llu moves, %.1f ns/move\n", mode ? "normalized" : "player square",
+			   (unsigned long long)played, elapsed * 1e9 / MAX(played, 1));
+	}
+
+	printf("hash: %u mismatches\n", wrong);
+
+	level_collection_release(coll);
+	return wrong ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+ * long session on the first level: random moves, then everything undone and
+ * redone, checking the hash and the lower bound at both ends
+ */
+static int
+bench_undo(int argc, char** argv) {
+	level_collection_t*	coll	= load_levels(argc > 0 ? argv[0] : NULL);
+	uint32				moves	= argc > 1 ? (uint32)atoi(argv[1]) : 1000000;
+	game_state_t		state;
+	uint64				start_hash, end_hash;
+	uint32				start_bound, end_bound;
+	uint32				seed	= 1;
+	size_t				played, m;
+	double				start, undo_time, redo_time;
+	bool				ok;
+
+	if( NULL == coll ) {
+		return EXIT_FAILURE;
+	}
+
+	if( 0 == coll->count || !game_init(&state, &(coll->levels[0]), 0) ) {
+		fprintf(stderr, "undo: %s\n", boxworld_error_string());
+		level_collection_release(coll);
+		return EXIT_FAILURE;
+	}
+
+	start_hash	= state.hash;
+	start_bound	= state.bound.value;
+	for( m = 0; m < moves; ++m ) {
+		seed	= seed * 1103515245u + 12345u;
+		game_next_state(&state, (KEY)((seed >> 16) & 3));
+	}
+	end_hash	= state.hash;
+	end_bound	= state.bound.value;
+	played		= state.played;
+
+	start	= boxworld_seconds();
+	for( m = 0; m < played; ++m ) {
+		game_next_state(&state, KEY_UNDO);
+	}
+	undo_time	= boxworld_seconds() - start;
+	ok			= state.hash == start_hash && state.bound.value == start_bound && state.board.player == state.initial.player;
+
+	start	= boxworld_seconds();
+	for( m = 0; m < played; ++m ) {
+		game_next_state(&state, KEY_REDO);
+	}
+	redo_time	= boxworld_seconds() - start;
+	ok			= ok && state.hash == end_hash && state.bound.value == end_bound;
+
+	printf("undo: %llu moves, log %.1f KB\n", (unsigned long long)played, (double)state.log.max / 1024.0);
+	printf("undo: %.1f ns/undo, %.1f ns/redo, %s\n", undo_time * 1e9 / MAX(played, 1), redo_time * 1e9 / MAX(played, 1),
+		   ok ? "consistent" : "MISMATCH");
+
+	game_release(&state);
+	level_collection_release(coll);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * solution checks: the solver's solution of every level is written as LURD,
+ * then checked 'copies' times on one thread and as a batch on all of them
+ */
+static int
+bench_lurd(int argc, char** argv) {
+	level_collection_t*	coll	= load_levels(argc > 0 ? argv[0] : NULL);
+	uint32				copies	= argc > 1 ? (uint32)atoi(argv[1]) : 10000;
+	uint32				threads	= argc > 2 ? (uint32)atoi(argv[2]) : (uint32)sysconf(_SC_NPROCESSORS_ONLN);
+	solver_params_t		params	= solver_default_params();
+	key_array_t			keys	= key_array_new();
+	char**				texts;
+	lurd_job_t*			jobs;
+	lurd_report_t*		reports;
+	uint32				solutions	= 0;
+	uint32				count, solved, i, l;
+	uint64				moves		= 0;
+	double				start, single, batch;
+
+	if( NULL == coll ) {
+		return EXIT_FAILURE;
+	}
+
+	params.time_limit	= 10.0;
+	texts	= (char**)calloc(MAX(coll->count, 1), sizeof(char*));
+	for( l = 0; l < coll->count; ++l ) {
+		board_t		b;
+
+		if( !board_from_level(&b, &(coll->levels[l])) ) {
+			continue;
+		}
+
+		if( SOLVER_SOLVED == solver_solve_board(&b, &params, &keys, NULL) ) {
+			texts[l]	= (char*)malloc(keys.count + 1);
+			lurd_write(&b, &keys, texts[l]);
+			++solutions;
+		}
+		board_release(&b);
+	}
+
+	count	= solutions * MAX(copies, 1);
+	jobs	= (lurd_job_t*)malloc(sizeof(lurd_job_t) * MAX(count, 1));
+	reports	= (lurd_report_t*)malloc(sizeof(lurd_report_t) * MAX(count, 1));
+	for( i = 0; i < count; ) {
+		for( l = 0; l < coll->count; ++l ) {
+			if( texts[l] ) {
+				jobs[i].level	= &(coll->levels[l]);
+				jobs[i].moves	= texts[l];
+				jobs[i].length	= strlen(texts[l]);
+				++i;
+			}
+		}
+	}
+
+	start	= boxworld_seconds();
+	for( i = 0, solved = 0; i < count; ++i ) {
+		solved	+= LURD_SOLVED == lurd_verify(jobs[i].level, jobs[i].moves, jobs[i].length, &(reports[i]));
+		moves	+= reports[i].moves;
+	}
+	single	= boxworld_seconds() - start;
+
+	start	= boxworld_seconds();
+	solved	+= lurd_verify_batch(jobs, count, threads, reports);
+	batch	= boxworld_seconds() - start;
+
+	printf("lurd: %u solutions, %llu moves, %u/%u solved\n", count, (unsigned long long)moves, solved, count * 2);
+	printf("lurd: 1 thread: %.0f solutions/s, %.1f M moves/s\n", count / MAX(single, 1e-9), moves / MAX(single, 1e-9) * 1e-6);
+	printf("lurd: %u threads: %.0f solutions/s, %.1f M moves/s\n", threads, count / MAX(batch, 1e-9), moves / MAX(batch, 1e-9) * 1e-6);
+
+	for( l = 0; l < coll->count; ++l ) {
+		free(texts[l]);
+	}
+	free(texts);
+	free(jobs);
+	free(reports);
+	key_array_release(&keys);
+	level_collection_release(coll);
+	return solved == count * 2 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* the queue based flood board_reachable used to be, as the reference */
+static uint32
+reachable_bfs(const board_t* b, uint32 from, uint64* reach) {
+	uint16		queue[BOARD_MAX_CELLS];
+	uint64		free_cells[BOARD_MAX_HEIGHT + 2];	/* one blocked row above and below */
+	uint64*		fc		= free_cells + 1;
+	uint32		head	= 0;
+	uint32		tail	= 0;
+	uint32		min_pos	= from;
+	uint32		y;
+
+	free_cells[0]				= 0;
+	free_cells[b->height + 1]	= 0;
+	for( y = 0; y < b->height; ++y ) {
+		fc[y]		= b->floor[y] & ~b->boxes[y];
+		reach[y]	= 0;
+	}
+
+	board_set(reach, from);
+	queue[tail++]	= (uint16)from;
+
+	/* the padding bit and the guard rows keep every neighbour test in bounds */
+	while( head < tail ) {
+		uint32	pos	= queue[head++];
+		uint32	n;
+
+		if( pos < min_pos ) {
+			min_pos	= pos;
+		}
+
+		n	= pos - BOARD_STRIDE;
+		if( board_test(free_cells, n + BOARD_STRIDE) && !board_test(reach, n) ) {
+			board_set(reach, n);
+			queue[tail++]	= (uint16)n;
+		}
+		n	= pos + BOARD_STRIDE;
+		if( board_test(free_cells, n + BOARD_STRIDE) && !board_test(reach, n) ) {
+			board_set(reach, n);
+			queue[tail++]	= (uint16)n;
+		}
+		n	= pos - 1;
+		if( board_test(free_cells, n + BOARD_STRIDE) && !board_test(reach, n) ) {
+			board_set(reach, n);
+			queue[tail++]	= (uint16)n;
+		}
+		n	= pos + 1;
+		if( board_test(free_cells, n + BOARD_STRIDE) && !board_test(reach, n) ) {
+			board_set(reach, n);
+			queue[tail++]	= (uint16)n;
+		}
+	}
+
+	return min_pos;
+}
+
+/*
+ * player reach from every free square of each level, bit plane flood fill
+ * against the scalar BFS. Levels are read from a file, or the biggest board
+ * is used
+ */
+static int
+bench_reach(int argc, char** argv) {
+	const char*			path		= argc > 0 ? argv[0] : NULL;
+	uint32				iterations	= argc > 1 ? (uint32)atoi(argv[1]) : 10;
+	level_collection_t*	coll;
+	uint64				reach[BOARD_MAX_HEIGHT];
+	uint64				check[BOARD_MAX_HEIGHT];
+	uint64				fills		= 0;
+	uint32				wrong		= 0;
+	double				flood		= 0.0;
+	double				bfs			= 0.0;
+	uint32				l, i, pos;
+
+	if( NULL == path || 0 == strcmp(path, "-") ) {
+		size_t	size;
+		char*	text	= make_big_level(&size);
+		coll	= level_collection_parse(text, size);
+		free(text);
+	} else {
+		coll	= level_collection_load(path);
+	}
+
+	if( NULL == coll ) {
+		fprintf(stderr, "reach: %s\n", boxworld_error_string());
+		return EXIT_FAILURE;
+	}
+
+	for( l = 0; l < coll->count; ++l ) {
+		board_t	b;
+
+		if( !board_from_level(&b, &(coll->levels[l])) ) {
+			continue;
+		}
+
+		for( pos = 0; pos < (b.height << BOARD_SHIFT); ++pos ) {
+			double	start;
+			uint32	a	= 0;
+			uint32	c	= 0;
+
+			if( !board_test(b.floor, pos) || board_test(b.boxes, pos) ) {
+				continue;
+			}
+
+			start	= boxworld_seconds();
+			for( i = 0; i < iterations; ++i ) {
+				a	= board_reachable(&b, pos, reach);
+			}
+			flood	+= boxworld_seconds() - start;
+
+			start	= boxworld_seconds();
+			for( i = 0; i < iterations; ++i ) {
+				c	= reachable_bfs(&b, pos, check);
+			}
+			bfs		+= boxworld_seconds() - start;
+
+			fills	+= iterations;
+			wrong	+= a != c || 0 != memcmp(reach, check, sizeof(uint64) * b.height);
+		}
+
+		board_release(&b);
+	}
+
+	printf("reach: %llu fills, %.3f us/fill flood, %.3f us/fill bfs\n", (unsigned long long)fills,
+		   flood * 1e6 / MAX(fills, 1), bfs * 1e6 / MAX(fills, 1));
+	printf("reach: %u mismatches\n", wrong);
+
+	level_collection_release(coll);
+	return wrong ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+ * many random sessions of the first level: the batch step against board_step
+ * on one board per session, with the same keys and the same results expected
+ */
+static int
+bench_batch(int argc, char** argv) {
+	level_collection_t*	coll	= load_levels(argc > 0 ? argv[0] : NULL);
+	uint32				envs	= argc > 1 ? (uint32)atoi(argv[1]) : 4096;
+	uint32				steps	= argc > 2 ? (uint32)atoi(argv[2]) : 1000;
+	env_batch_t			eb;
+	board_t*			boards;
+	KEY*				keys;
+	uint8*				results;
+	uint32				seed	= 1;
+	uint32				wrong	= 0;
+	double				batch	= 0.0;
+	double				single	= 0.0;
+	double				start;
+	uint32				e, i;
+
+	if( NULL == coll ) {
+		return EXIT_FAILURE;
+	}
+
+	if( 0 == coll->count || !env_batch_init(&eb, &(coll->levels[0]), envs) ) {
+		fprintf(stderr, "batch: %s\n", boxworld_error_string());
+		level_collection_release(coll);
+		return EXIT_FAILURE;
+	}
+
+	boards	= (board_t*)malloc(sizeof(board_t) * MAX(envs, 1));
+	keys	= (KEY*)malloc(sizeof(KEY) * MAX(envs, 1));
+	results	= (uint8*)malloc(MAX(envs, 1));
+	for( e = 0; e < envs; ++e ) {
+		board_from_level(&(boards[e]), &(coll->levels[0]));
+	}
+
+	for( i = 0; i < steps; ++i ) {
+		for( e = 0; e < envs; ++e ) {
+			seed	= seed * 1103515245u + 12345u;
+			keys[e]	= (KEY)((seed >> 16) & 3);
+		}
+
+		start	= boxworld_seconds();
+		env_batch_step(&eb, keys, results);
+		batch	+= boxworld_seconds() - start;
+
+		start	= boxworld_seconds();
+		for( e = 0; e < envs; ++e ) {
+			wrong	+= board_step(&(boards[e]), keys[e]) != results[e];
+		}
+		single	+= boxworld_seconds() - start;
+	}
+
+	for( e = 0; e < envs; ++e ) {
+		board_t	b;
+		board_allocate(&b, boards[e].width, boards[e].height);
+		env_batch_board(&eb, e, &b);
+		wrong	+= b.player != boards[e].player || board_boxes_hash(&b) != board_boxes_hash(&(boards[e]));
+		board_release(&b);
+		board_release(&(boards[e]));
+	}
+
+	printf("batch: %u environments, %u steps\n", envs, steps);
+	printf("batch: %.1f M steps/s batched, %.1f M steps/s one board at a time\n",
+		   (double)envs * steps / MAX(batch, 1e-9) * 1e-6, (double)envs * steps / MAX(single, 1e-9) * 1e-6);
+	printf("batch: %u mismatches\n", wrong);
+
+	free(boards);
+	free(keys);
+	free(results);
+	env_batch_release(&eb);
+	level_collection_release(coll);
+	return wrong ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+ * backward analysis of every level start, then a random pull session undone
+ * move by move, which must land back on the start
+ */
+static int
+bench_pull(int argc, char** argv) {
+	level_collection_t*	coll	= load_levels(argc > 0 ? argv[0] : NULL);
+	uint32				budget	= argc > 1 ? (uint32)atoi(argv[1]) : 1000000;
+	uint32				wrong	= 0;
+	uint32				seed	= 1;
+	uint32				l, m;
+
+	if( NULL == coll ) {
+		return EXIT_FAILURE;
+	}
+
+	for( l = 0; l < coll->count; ++l ) {
+		game_state_t	state;
+		pull_stats_t	st;
+		uint64			start_hash;
+		double			start;
+
+		if( !game_init(&state, &(coll->levels[l]), l) ) {
+			continue;
+		}
+
+		start	= boxworld_seconds();
+		pull_search(&(state.board), budget, &st);
+		printf("pull: level %u: %s, %u states, %.3f s\n", l + 1, pull_result_string(st.result), st.states,
+			   boxworld_seconds() - start);
+
+		start_hash	= state.hash;
+		for( m = 0; m < 10000; ++m ) {
+			seed	= seed * 1103515245u + 12345u;
+			game_pull_state(&state, (KEY)((seed >> 16) & 3));
+		}
+		while( state.played ) {
+			game_next_state(&state, KEY_UNDO);
+		}
+		wrong	+= state.hash != start_hash;
+
+		game_release(&state);
+	}
+
+	printf("pull: %u undo mismatches\n", wrong);
+
+	level_collection_release(coll);
+	return wrong ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* corridor levels of every length and height, solved by pushing right all the way */
+static level_collection_t*
+make_corridors(uint32 lengths, uint32 heights) {
+	level_collection_t*	coll;
+	char*				text	= (char*)malloc((size_t)lengths * heights * (64 * 48 + 16) + 1);
+	size_t				len		= 0;
+	uint32				k, r, i;
+
+	assert( NULL != text );
+
+	for( k = 0; k < lengths; ++k ) {
+		for( r = 0; r < heights; ++r ) {
+			len	+= (size_t)sprintf(text + len, "; %u %u\n\n", k, r);
+			for( i = 0; i < 3 + r; ++i ) {
+				uint32	x;
+				for( x = 0; x < k + 5; ++x ) {
+					text[len++]	= 1 == i && x > 0 && x < k + 4 ? (1 == x ? '@' : 2 == x ? '$' : x == k + 3 ? '.' : ' ') : '#';
+				}
+				text[len++]	= '\n';
+			}
+			text[len++]	= '\n';
+		}
+	}
+
+	coll	= level_collection_parse(text, len);
+	free(text);
+	return coll;
+}
+
+/*
+ * records a solution per level in a fresh store, then reopens it and times
+ * the lookups. Every stored solution is replayed, and the store is opened
+ * once more without its index to check the rebuild
+ */
+static int
+bench_store(int argc, char** argv) {
+	const char*			path	= argc > 1 ? argv[1] : "bench.bws";
+	uint32				lookups	= argc > 2 ? (uint32)atoi(argv[2]) : 1000000;
+	level_collection_t*	coll;
+	solution_store_t*	store;
+	key_array_t			keys	= key_array_new();
+	uint64*				prints;
+	char				index_path[4096];
+	uint32				recorded	= 0;
+	uint32				wrong		= 0;
+	uint64				pushes		= 0;
+	double				start, record_time, open_time, elapsed;
+	uint32				l, i;
+
+	coll	= argc > 0 && strcmp(argv[0], "-") ? load_levels(argv[0]) : make_corridors(59, 40);
+	if( NULL == coll ) {
+		return EXIT_FAILURE;
+	}
+
+	snprintf(index_path, sizeof(index_path), "%s.idx", path);
+	unlink(path);
+	unlink(index_path);
+
+	store	= solution_store_open(path);
+	prints	= (uint64*)malloc(sizeof(uint64) * MAX(coll->count, 1));
+	if( NULL == store || NULL == prints ) {
+		fprintf(stderr, "store: %s\n", boxworld_error_string());
+		level_collection_release(coll);
+		free(prints);
+		return EXIT_FAILURE;
+	}
+
+	start	= boxworld_seconds();
+	for( l = 0; l < coll->count; ++l ) {
+		const level_t*	lvl	= &(coll->levels[l]);
+		uint32			w;
+
+		prints[l]	= level_fingerprint(lvl);
+
+		/* the corridors are pushed right, other levels go through the solver */
+		keys.count	= 0;
+		if( argc > 0 && strcmp(argv[0], "-") ) {
+			solver_params_t	params	= solver_default_params();
+			if( SOLVER_SOLVED != solver_solve(lvl, &params, &keys, NULL) ) {
+				continue;
+			}
+		} else {
+			for( w = 0; w < lvl->width - 4; ++w ) {
+				key_array_push(&keys, KEY_RIGHT);
+			}
+		}
+
+		recorded	+= solution_store_record(store, lvl, &keys, &l, sizeof(uint32));
+		wrong		+= solution_store_record(store, lvl, &keys, NULL, 0);		/* not better */
+	}
+	record_time	= boxworld_seconds() - start;
+	solution_store_close(store);
+
+	start	= boxworld_seconds();
+	store	= solution_store_open(path);
+	open_time	= boxworld_seconds() - start;
+	if( NULL == store ) {
+		fprintf(stderr, "store: %s\n", boxworld_error_string());
+		level_collection_release(coll);
+		free(prints);
+		return EXIT_FAILURE;
+	}
+	wrong	+= solution_store_count(store) != recorded;
+
+	/* every record replays and carries its level index */
+	for( l = 0; l < coll->count; ++l ) {
+		const store_record_t*	r	= solution_store_find(store, prints[l]);
+		lurd_report_t			report;
+		char*					lurd;
+		board_t					b;
+
+		if( NULL == r ) {
+			continue;
+		}
+
+		store_record_keys(r, &keys);
+		lurd	= (char*)malloc(keys.count + 1);
+		if( NULL == lurd || !board_from_level(&b, &(coll->levels[l])) ) {
+			free(lurd);
+			++wrong;
+			continue;
+		}
+
+		lurd_write(&b, &keys, lurd);
+		lurd_verify(&(coll->levels[l]), lurd, keys.count, &report);
+		wrong	+= LURD_SOLVED != report.result || report.pushes != r->pushes || report.moves != r->moves ||
+				   r->data_size != sizeof(uint32) || *(const uint32*)store_record_data(r) != l;
+
+		board_release(&b);
+		free(lurd);
+	}
+
+	start	= boxworld_seconds();
+	for( i = 0; i < lookups; ++i ) {
+		const store_record_t*	r	= solution_store_find(store, prints[i % coll->count]);
+		pushes	+= r ? r->pushes : 0;
+	}
+	elapsed	= boxworld_seconds() - start;
+	solution_store_close(store);
+
+	/* the index is a cache, the log alone must give the same store */
+	unlink(index_path);
+	store	= solution_store_open(path);
+	if( NULL == store ) {
+		fprintf(stderr, "store: %s\n", boxworld_error_string());
+		++wrong;
+	} else {
+		wrong	+= solution_store_count(store) != recorded;
+		solution_store_close(store);
+	}
+
+	printf("store: %u levels, %u recorded in %.3f s, reopened in %.6f s\n", coll->count, recorded, record_time, open_time);
+	printf("store: %u lookups in %.3f s, %.1f M/s (%llu pushes)\n", lookups, elapsed, (double)lookups / elapsed / 1e6, (unsigned long long)pushes);
+	printf("store: %u mismatches\n", wrong);
+
+	unlink(path);
+	unlink(index_path);
+	key_array_release(&keys);
+	free(prints);
+	level_collection_release(coll);
+	return wrong ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static int
+compare_uint64(const void* a, const void* b) {
+	uint64	x	= *(const uint64*)a;
+	uint64	y	= *(const uint64*)b;
+	return x < y ? -1 : (x > y);
+}
+
+static uint32
+count_distinct(uint64* v, uint32 count) {
+	uint32	i, n	= count ? 1 : 0;
+
+	qsort(v, count, sizeof(uint64), compare_uint64);
+	for( i = 1; i < count; ++i ) {
+		n	+= v[i] != v[i - 1];
+	}
+	return n;
+}
+
+/*
+ * random sessions snapshotted after every move: exact snapshots must decode
+ * to the played board, normalized ones must tell positions apart exactly
+ * like the normalized game hash does
+ */
+static int
+bench_snapshot(int argc, char** argv) {
+	level_collection_t*	coll	= load_levels(argc > 0 ? argv[0] : NULL);
+	uint32				moves	= argc > 1 ? (uint32)atoi(argv[1]) : 100000;
+	uint32				wrong	= 0;
+	uint32				seed	= 1;
+	uint32				l, m, y;
+
+	if( NULL == coll ) {
+		return EXIT_FAILURE;
+	}
+
+	moves	= MAX(moves, 1);
+	for( l = 0; l < coll->count; ++l ) {
+		const level_t*		lvl	= &(coll->levels[l]);
+		game_state_t		state;
+		snapshot_codec_t	exact, norm;
+		board_t				b;
+		uint64*				snaps;
+		uint64*				norms;
+		uint64*				hashes;
+		uint64*				snap_hashes;
+		double				start, elapsed;
+		uint32				distinct;
+
+		if( !game_init(&state, lvl, l) ) {
+			continue;
+		}
+		game_hash_normalize(&state, true);
+
+		if( !snapshot_codec_init(&exact, &(state.board), false) || !snapshot_codec_init(&norm, &(state.board), true) ||
+			!board_allocate(&b, lvl->width, lvl->height) ) {
+			fprintf(stderr, "snapshot: %s\n", boxworld_error_string());
+			return EXIT_FAILURE;
+		}
+		board_copy(&b, &(state.initial));
+
+		snaps		= (uint64*)malloc(sizeof(uint64) * exact.words * moves);
+		norms		= (uint64*)malloc(sizeof(uint64) * norm.words * moves);
+		hashes		= (uint64*)malloc(sizeof(uint64) * moves * 2);
+		snap_hashes	= hashes + moves;
+		assert( NULL != snaps && NULL != norms && NULL != hashes );
+
+		for( m = 0; m < moves; ++m ) {
+			uint64*	s	= snaps + (size_t)m * exact.words;
+
+			seed	= seed * 1103515245u + 12345u;
+			game_next_state(&state, (KEY)((seed >> 16) % 5));		/* some undos too */
+
+			snapshot_encode(&exact, &(state.board), s);
+			snapshot_encode(&norm, &(state.board), norms + (size_t)m * norm.words);
+			hashes[m]		= state.hash;
+			snap_hashes[m]	= snapshot_hash(&norm, norms + (size_t)m * norm.words);
+
+			wrong	+= !snapshot_decode(&exact, s, &b) || b.player != state.board.player ||
+					   b.boxes_on_goal != state.board.boxes_on_goal;
+			for( y = 0; y < b.height; ++y ) {
+				wrong	+= b.boxes[y] != state.board.boxes[y];
+			}
+		}
+
+		/* decode and encode again, the words must come back */
+		start	= boxworld_seconds();
+		for( m = 0; m < moves; ++m ) {
+			uint64	again[BOARD_MAX_CELLS / 64];
+			snapshot_decode(&exact, snaps + (size_t)m * exact.words, &b);
+			snapshot_encode(&exact, &b, again);
+			wrong	+= 0 != snapshot_compare(&exact, again, snaps + (size_t)m * exact.words);
+		}
+		elapsed	= boxworld_seconds() - start;
+
+		/* a game restored from a checkpoint is the position that was played */
+		game_restore(&state, &exact, snaps + (size_t)(moves / 2) * exact.words);
+		wrong	+= state.hash != hashes[moves / 2] || 0 != state.played;
+
+		distinct	= count_distinct(hashes, moves);
+		wrong		+= distinct != count_distinct(snap_hashes, moves);
+
+		printf("snapshot: level %u: %u squares, %u bits, %u bytes (cells %u bytes, %.0fx), %u positions, %.1f ns/round trip\n",
+			   l + 1, exact.squares, exact.bits, exact.words * 8, lvl->width * lvl->height * (uint32)sizeof(cell_t),
+			   (double)(lvl->width * lvl->height * sizeof(cell_t)) / (exact.words * 8), distinct, elapsed * 1e9 / moves);
+
+		free(snaps);
+		free(norms);
+		free(hashes);
+		board_release(&b);
+		snapshot_codec_release(&exact);
+		snapshot_codec_release(&norm);
+		game_release(&state);
+	}
+
+	printf("snapshot: %u mismatches\n", wrong);
+
+	level_collection_release(coll);
+	return wrong ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+ * plays the solution of a level with a hint worker running: most moves come
+ * in a burst (each one cancels the search of the previous), after every
+ * 'burst' moves the game polls for the hint like a frame loop would
+ */
+static int
+bench_hint(int argc, char** argv) {
+	level_collection_t*	coll	= load_levels(argc > 0 ? argv[0] : NULL);
+	uint32				level	= argc > 1 ? (uint32)atoi(argv[1]) : 0;
+	uint32				burst	= argc > 2 ? (uint32)MAX(atoi(argv[2]), 1) : 4;
+	solver_params_t		params	= solver_default_params();
+	key_array_t			keys	= key_array_new();
+	game_state_t		state;
+	hint_worker_t*		w;
+	hint_t				hint;
+	double				total	= 0.0, worst = 0.0, poll_worst = 0.0;
+	uint32				answered	= 0;
+	uint32				wrong		= 0;
+	size_t				k;
+
+	if( NULL == coll ) {
+		return EXIT_FAILURE;
+	}
+
+	if( level >= coll->count || SOLVER_SOLVED != solver_solve(&(coll->levels[level]), &params, &keys, NULL) ||
+		!game_init(&state, &(coll->levels[level]), level) ) {
+		fprintf(stderr, "hint: no solution for level %u\n", level + 1);
+		level_collection_release(coll);
+		return EXIT_FAILURE;
+	}
+
+	params.time_limit	= 5.0;
+	w	= hint_worker_create(&(coll->levels[level]), &params);
+	if( NULL == w ) {
+		fprintf(stderr, "hint: %s\n", boxworld_error_string());
+		game_release(&state);
+		key_array_release(&keys);
+		level_collection_release(coll);
+		return EXIT_FAILURE;
+	}
+
+	for( k = 0; k < keys.count; ++k ) {
+		bool	ready	= false;
+
+		game_next_state(&state, keys.array[k]);
+		hint_request(w, &(state.board));
+		if( (k + 1) % burst && k + 1 < keys.count ) {
+			continue;
+		}
+
+		while( !ready ) {
+			double	start	= boxworld_seconds();
+			ready		= hint_latest(w, &hint);
+			poll_worst	= MAX(poll_worst, boxworld_seconds() - start);
+			if( !ready ) {
+				struct timespec	nap	= { 0, 200000 };
+				nanosleep(&nap, NULL);
+			}
+		}
+
+		++answered;
+		total	+= hint.latency;
+		worst	= MAX(worst, hint.latency);
+
+		/* the box and the square it goes to */
+		if( HINT_PUSH == hint.status ) {
+			uint32	to	= hint.box + board_delta(hint.dir);
+			wrong	+= !board_test(state.board.boxes, hint.box) || !board_walkable(&(state.board), to) ||
+					   board_test(state.board.boxes, to);
+		} else {
+			wrong	+= HINT_SOLVED != hint.status || k + 1 != keys.count;
+		}
+	}
+
+	printf("hint: level %u, %llu moves, %u hints waited for, the other requests cancelled\n",
+		   level + 1, (unsigned long long)keys.count, answered);
+	printf("hint: latency %.3f ms mean, %.3f ms max, hint_latest %.0f ns max\n",
+		   total * 1e3 / MAX(answered, 1), worst * 1e3, poll_worst * 1e9);
+	printf("hint: %u wrong hints\n", wrong);
+
+	hint_worker_release(w);
+	game_release(&state);
+	key_array_release(&keys);
+	level_collection_release(coll);
+	return wrong ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+typedef struct {
+	const char*	name;
+	int			(*run)(int argc, char** argv);
+	const char*	usage;
+} bench_t;
+
+static const bench_t	benches[]	= {
+	{ "parse",		bench_parse,		"parse [file.sok|-] [iterations]" },
+	{ "levelpack",	bench_levelpack,	"levelpack <file.bwp> [switches]" },
+	{ "board",		bench_board,		"board [file.sok|-] [iterations]" },
+	{ "solve",		bench_solve,		"solve [file.sok|-] [first] [count] [budget MB] [deadlocks 0|1]" },
+	{ "psolve",		bench_psolve,		"psolve [file.sok|-] [level] [threads]" },
+	{ "bound",		bench_bound,		"bound [file.sok|-] [moves per level]" },
+	{ "hash",		bench_hash,			"hash [file.sok|-] [moves per level]" },
+	{ "undo",		bench_undo,			"undo [file.sok|-] [moves]" },
+	{ "lurd",		bench_lurd,			"lurd [file.sok|-] [copies] [threads]" },
+	{ "reach",		bench_reach,		"reach [file.sok|-] [iterations]" },
+	{ "batch",		bench_batch,		"batch [file.sok|-] [environments] [steps]" },
+	{ "pull",		bench_pull,			"pull [file.sok|-] [state budget]" },
+	{ "store",		bench_store,		"store [file.sok|-] [store path] [lookups]" },
+	{ "snapshot",	bench_snapshot,		"snapshot [file.sok|-] [moves per level]" },
+	{ "hint",		bench_hint,			"hint [file.sok|-] [level] [moves per poll]" },
+};
+
+int
+main(int argc, char** argv) {
+	uint32	b;
+
+	if( argc > 1 ) {
+		for( b = 0; b < sizeof(benches) / sizeof(bench_t); ++b ) {
+			if( 0 == strcmp(argv[1], benches[b].name) ) {
+				return benches[b].run(argc - 2, argv + 2);
+			}
+		}
+	}
+
+	fprintf(stderr, "usage:\n");
+	for( b = 0; b < sizeof(benches) / sizeof(bench_t); ++b ) {
+		fprintf(stderr, "\t%s %s\n", argv[0], benches[b].usage);
+	}
+	return EXIT_FAILURE;
+}
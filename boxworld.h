@@ -25,6 +25,8 @@
 #include <malloc.h>
 #include <math.h>
 #include <assert.h>
+#include <stdint.h>
+#include <stddef.h>
 
 #include "c99-3d-math/3dmath.h"
 #include "emuGLES2/emuGLES2.h"
@@ -70,6 +72,9 @@ extern void*			boxworld_error(BOXWORLD_ERROR err, const char* string);
 extern BOXWORLD_ERROR	boxworld_error_number();
 extern const char*		boxworld_error_string();
 
+/* monotonic wall clock, in seconds */
+extern double			boxworld_seconds();
+
 /*
  * image.c
  */
@@ -110,21 +115,43 @@ void					image_atlas_release(atlas_t* atlas);
 /*
  * render.c
  */
+/* 16 bytes: the texture coordinates and the color go as normalized integers */
 typedef struct {
 	vec2_t		position;
-	vec2_t		tex;
-	color4_t	color;
+	uint16		tex[2];
+	color4b_t	color;
 } render_vertex_t;
 
-typedef	render_vertex_t	render_quad_t[6];
+/* the 4 corners, the two triangles come from the shared index buffer */
+typedef	render_vertex_t	render_quad_t[4];
+
+/* 28 bytes, the whole quad when the vertex shader builds the corners */
+typedef struct {
+	vec2_t		start;
+	vec2_t		end;
+	uint16		tex[4];		/* start u v, end u v */
+	color4b_t	color;
+} render_instance_t;
 
 enum {
-	MAX_QUADS	= 8192,
+	MAX_QUADS		= 8192,		/* the indices are 16 bits, so no more than 16384 */
+	MAX_TEXTURES	= 16,
 };
 
+/* a submitted quad, drawn at renderer_end in (layer, texture) order */
+typedef struct {
+	render_instance_t	quad;
+	uint32				key;		/* layer * MAX_TEXTURES + texture */
+	uint32				order;		/* submission order, keeps the sort stable */
+} render_sprite_t;
+
+ARRAY_TYPE(render_sprite_array, render_sprite_t)
+
 typedef struct {
-	GLuint	texture;
+	GLuint	textures[MAX_TEXTURES];
+	uint32	numTextures;
 	GLuint	vbo;
+	GLuint	ibo;
 	GLuint	program;
 
 	GLuint	uniViewport;
@@ -134,13 +161,38 @@ typedef struct {
 	GLuint	attrTexCoord;
 	GLuint	attrColor;
 
-	render_quad_t	quads[MAX_QUADS];
+	/* instanced path, instProgram is 0 when the driver can't do it */
+	GLuint	instProgram;
+	GLuint	cornerVbo;
+
+	GLuint	uniInstViewport;
+	GLuint	uniInstTexture;
+
+	GLuint	attrCorner;
+	GLuint	attrRect;
+	GLuint	attrTexRect;
+	GLuint	attrInstColor;
+
+	bool	instanced;
+
+	render_sprite_array_t	sprites;		/* the frame draw list */
+	uint32	currentTexture;			/* of the quads submitted next */
+	uint32	currentLayer;
+
+	render_quad_t		quads[MAX_QUADS];
+	render_instance_t	instances[MAX_QUADS];
 
 	uint32	numQuads;
+	uint32	batchTexture;
+	uint32	drawCalls;				/* of the last frame */
 } gfx_context_t;
 
 gfx_context_t*			renderer_create_context(const image_t* tex);
 void					renderer_release(gfx_context_t* ctx);
+bool					renderer_add_texture(gfx_context_t* ctx, const image_t* img, uint32* id);
+void					renderer_set_texture(gfx_context_t* ctx, uint32 id);
+void					renderer_set_layer(gfx_context_t* ctx, uint32 layer);
+bool					renderer_set_instanced(gfx_context_t* ctx, bool instanced);
 void					renderer_begin(gfx_context_t* ctx, int width, int height);
 void					renderer_quad(gfx_context_t* ctx, vec2_t sv, vec2_t st, vec2_t ev, vec2_t et, color4_t col);
 void					renderer_end(gfx_context_t* ctx);
@@ -207,8 +259,11 @@ typedef struct {
 } level_t;
 
 typedef struct {
-	uint32		count;
-	level_t*	levels;
+	uint32			count;
+	level_t*		levels;
+	cell_t*			cells;			/* cell storage shared by all the levels */
+	const char**	solutions;		/* reference LURD solution of each level, NULL if there's none */
+	char*			solution_text;	/* storage for the solutions */
 } level_collection_t;
 
 typedef enum {
@@ -223,14 +278,556 @@ typedef enum {
 
 ARRAY_TYPE(key_array, KEY)
 
+/*
+ * bit-packed level: walls, floor, goals and boxes are kept as separate bit
+ * planes, one 64 bit word per row. The last bit of each row is padding and is
+ * never set, so stepping off the left or right border always lands on a
+ * blocked cell. A position is (y << BOARD_SHIFT) + x.
+ */
+enum {
+	BOARD_SHIFT			= 6,
+	BOARD_STRIDE		= 1 << BOARD_SHIFT,
+	BOARD_MAX_WIDTH		= BOARD_STRIDE - 1,
+	BOARD_MAX_HEIGHT	= 64,
+	BOARD_MAX_CELLS		= BOARD_STRIDE * BOARD_MAX_HEIGHT,
+	BOARD_DIST_INF		= 0xFFFF,
+	BOARD_PLANES		= 5,
+};
+
+typedef struct {
+	uint32		width;
+	uint32		height;
+	uint32		player;			/* player position */
+	uint32		box_count;
+	uint32		boxes_on_goal;
+	uint64*		walls;			/* all the planes share one allocation (walls is the base) */
+	uint64*		floor;			/* walkable cells: BG_GROUND and BG_PLACE */
+	uint64*		goals;
+	uint64*		dead;			/* floor cells from which a box can never reach a goal */
+	uint64*		boxes;
+} board_t;
+
+typedef enum {
+	MOVE_NONE		= 0,		/* the move was blocked */
+	MOVE_WALK		= 1 << 0,
+	MOVE_PUSH		= 1 << 1,
+	MOVE_SOLVED		= 1 << 2,
+	MOVE_DEADLOCK	= 1 << 3,	/* a box was pushed on a dead square */
+	MOVE_PULL		= 1 << 4,	/* a box was pulled, see board_pull */
+} MOVE_RESULT;
+
+static INLINE uint32	board_pos(uint32 x, uint32 y)					{ return (y << BOARD_SHIFT) + x; }
+static INLINE uint32	board_x(uint32 pos)								{ return pos & (BOARD_STRIDE - 1); }
+static INLINE uint32	board_y(uint32 pos)								{ return pos >> BOARD_SHIFT; }
+static INLINE bool		board_test(const uint64* plane, uint32 pos)		{ return (plane[pos >> BOARD_SHIFT] >> (pos & (BOARD_STRIDE - 1))) & 1; }
+static INLINE void		board_set(uint64* plane, uint32 pos)			{ plane[pos >> BOARD_SHIFT] |= (uint64)1 << (pos & (BOARD_STRIDE - 1)); }
+static INLINE void		board_clear(uint64* plane, uint32 pos)			{ plane[pos >> BOARD_SHIFT] &= ~((uint64)1 << (pos & (BOARD_STRIDE - 1))); }
+static INLINE bool		board_solved(const board_t* b)					{ return b->boxes_on_goal == b->box_count; }
+
+/* walkable and inside the board (positions above the first row wrap to huge values) */
+static INLINE bool		board_walkable(const board_t* b, uint32 pos)	{ return pos < (b->height << BOARD_SHIFT) && board_test(b->floor, pos); }
+
+/* position offset for a direction key (KEY_UP..KEY_LEFT) */
+static INLINE uint32	board_delta(KEY dir) {
+	switch( dir ) {
+	case KEY_UP		: return (uint32)-BOARD_STRIDE;
+	case KEY_RIGHT	: return 1;
+	case KEY_DOWN	: return BOARD_STRIDE;
+	case KEY_LEFT	: return (uint32)-1;
+	default			: return 0;
+	}
+}
+
+/*
+ * zobrist keys are derived from the position with a splitmix64 finalizer so
+ * no table has to be initialized or shared between threads
+ */
+typedef enum {
+	ZOBRIST_BOX		= 0,
+	ZOBRIST_PLAYER	= 1,
+} ZOBRIST_KIND;
+
+static INLINE uint64	zobrist_key(ZOBRIST_KIND kind, uint32 pos) {
+	uint64	z	= (((uint64)pos << 1) | (uint64)kind) * 0x9E3779B97F4A7C15ull;
+	z	= (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z	= (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+bool					board_from_level(board_t* b, const level_t* lvl);
+bool					board_allocate(board_t* b, uint32 width, uint32 height);
+void					board_release(board_t* b);
+void					board_copy(board_t* dst, const board_t* src);
+bool					board_to_level(const board_t* b, level_t* lvl);
+uint32					board_step(board_t* b, KEY dir);
+uint32					board_unstep(board_t* b, KEY dir, bool pushed);
+uint32					board_reachable(const board_t* b, uint32 from, uint64* reach);
+uint64					board_boxes_hash(const board_t* b);
+void					board_dead_squares(const board_t* b, uint64* dead);
+void					board_push_distances(const board_t* b, uint16* dist);
+bool					board_walk_to(board_t* b, uint32 to, key_array_t* keys);
+bool					board_push_keys(board_t* b, uint32 box, KEY dir, key_array_t* keys);
+
+void					level_release(level_t* lvl);
+
+/*
+ * lowerbound.c
+ *
+ * admissible lower bound on the pushes left: the minimum cost assignment of
+ * boxes to goals over the push distance of each box to each goal
+ */
+#define LOWER_BOUND_INF		0xFFFFFFFFu		/* some box can't reach a goal of its own */
+
+typedef struct {
+	uint32		box_count;
+	uint32		value;			/* current bound, LOWER_BOUND_INF when the boxes can't all be placed */
+	uint32		cells;			/* stride of the distance tables */
+	uint32		inf_cost;		/* cost of an unreachable goal, more than any complete assignment */
+	uint16*		dist;			/* pushes to each goal from each cell, one table per goal */
+	uint16*		boxes;			/* box position of each row */
+	int64_t*	u;				/* row potentials, 1 based (u is the base of the allocation) */
+	int64_t*	v;				/* column potentials, column 0 is the search root */
+	int64_t*	minv;
+	uint32*		match;			/* row matched to each column, 0 for none */
+	uint32*		assigned;		/* column matched to each row */
+	uint32*		way;
+	uint8*		used;
+} lower_bound_t;
+
+bool					lower_bound_init(lower_bound_t* lb, const board_t* b);
+void					lower_bound_release(lower_bound_t* lb);
+void					lower_bound_reset(lower_bound_t* lb, const board_t* b);
+void					lower_bound_move(lower_bound_t* lb, uint32 from, uint32 to);
+
+/*
+ * level.c: game state
+ *
+ * undo log, one byte per move: the direction and whether a box was pushed,
+ * enough to step the board back without a snapshot
+ */
+enum {
+	MOVE_LOG_DIR	= 3,
+	MOVE_LOG_PUSH	= 1 << 2,	/* a box moved */
+	MOVE_LOG_PULL	= 1 << 3,	/* played with game_pull_state */
+};
+
+ARRAY_TYPE(move_log, uint8)
+
 typedef struct {
-	uint32		player_pos;
 	uint32		current_level;
-	level_t		current;
-	key_array_t	keys;
+	uint32		last_move;		/* MOVE_RESULT flags of the last key */
+	board_t		initial;
+	board_t		board;
+	lower_bound_t	bound;		/* minimum pushes left, kept up to date on every push */
+	uint64		hash;			/* zobrist hash of the boxes and the player, see game_hash_normalize */
+	uint64		box_hash;		/* zobrist hash of the boxes alone */
+	uint32		player_key;		/* square hashed for the player */
+	bool		normalize;		/* hash the player region instead of the player square */
+	move_log_t	log;			/* played moves, followed by the undone ones */
+	size_t		played;			/* records in the log up to the current position */
 } game_state_t;
 
+bool					game_init(game_state_t* state, const level_t* lvl, uint32 level_index);
+void					game_release(game_state_t* state);
+/* KEY_UNDO reports the flags of the move it took back, MOVE_NONE when there was none */
 void					game_next_state(game_state_t* state, KEY key);
 
+/*
+ * pull mode: the player walks and drags along a box standing right behind
+ * it. Pulls share the move log with pushes, so KEY_UNDO and KEY_REDO (from
+ * either function) work on mixed sessions.
+ */
+void					game_pull_state(game_state_t* state, KEY key);
+
+/*
+ * with normalize the player is hashed by the smallest square of its region,
+ * so positions that only differ by walking hash the same, as in the solver.
+ * That costs a reachability flood per push; walks stay O(1) either way.
+ */
+void					game_hash_normalize(game_state_t* state, bool normalize);
+
+/*
+ * snapshot.c
+ *
+ * packed positions: the player square and the sorted box squares, each as
+ * its number among the floor squares, in the fewest bits that hold them.
+ * With normalize the player is stored as the smallest square of its region
+ * (what a visited table wants), otherwise as its own square (savegames,
+ * replay checkpoints). A snapshot is words uint64, equal positions give
+ * equal words so snapshots can be hashed and compared without decoding.
+ */
+typedef struct {
+	uint32		squares;		/* floor squares */
+	uint32		bits;			/* per square number */
+	uint32		box_count;
+	uint32		words;			/* uint64 per snapshot */
+	bool		normalize;
+	uint16*		number;			/* square number of each board position */
+	uint16*		pos;			/* board position of each square number */
+} snapshot_codec_t;
+
+/* b is any position of the level, only its floor and box count are used */
+bool					snapshot_codec_init(snapshot_codec_t* c, const board_t* b, bool normalize);
+void					snapshot_codec_release(snapshot_codec_t* c);
+/* out holds c->words words */
+void					snapshot_encode(const snapshot_codec_t* c, const board_t* b, uint64* out);
+/* sets the boxes and the player of b, a board of the level. False (b untouched) on a corrupted snapshot */
+bool					snapshot_decode(const snapshot_codec_t* c, const uint64* in, board_t* b);
+uint64					snapshot_hash(const snapshot_codec_t* c, const uint64* s);
+int						snapshot_compare(const snapshot_codec_t* c, const uint64* a, const uint64* b);
+/* loads a snapshot of the state level, the move log starts over */
+bool					game_restore(game_state_t* state, const snapshot_codec_t* c, const uint64* s);
+
+/*
+ * pull.c
+ *
+ * reverse play and backward analysis. board_pull moves the player towards
+ * dir and, with pull, drags the box standing behind it onto the square the
+ * player left.
+ */
+typedef enum {
+	PULL_SOLVABLE,
+	PULL_UNSOLVABLE,		/* no goal configuration pulls to the position */
+	PULL_UNKNOWN,			/* the state budget ran out */
+} PULL_RESULT;
+
+typedef struct {
+	PULL_RESULT		result;
+	uint32			states;		/* states generated */
+	uint32			expanded;
+} pull_stats_t;
+
+uint32					board_pull(board_t* b, KEY dir, bool pull);
+
+/*
+ * goal configurations: with a box on every goal, the player regions are
+ * written as their smallest square to regions (up to max). Returns the
+ * region count
+ */
+uint32					board_goal_regions(const board_t* b, uint32* regions, uint32 max);
+
+/* pulls from every goal configuration, breadth first, until the box layout and player region of b turn up */
+PULL_RESULT				pull_search(const board_t* b, uint32 max_states, pull_stats_t* stats);
+const char*				pull_result_string(PULL_RESULT res);
+
+/*
+ * envbatch.c
+ *
+ * count sessions of the same level stepped together, structure of arrays:
+ * one slab for the boxes of all the environments, one array per field.
+ * The bitmaps are 32 bit words, square pos is bit (pos & 31) of word (pos >> 5)
+ */
+typedef struct {
+	uint32		count;
+	uint32		words;			/* words per bitmap, two per row */
+	board_t		initial;		/* the level and the start position */
+	uint32*		floor;			/* shared floor, goals and dead bitmaps then the box slab (floor is the base of the allocation) */
+	uint32*		goals;
+	uint32*		dead;
+	uint32*		boxes;			/* environment e starts at boxes[e * words] */
+	uint32*		player;			/* per environment (player is the base of the allocation) */
+	uint32*		boxes_on_goal;
+} env_batch_t;
+
+bool					env_batch_init(env_batch_t* eb, const level_t* lvl, uint32 count);
+void					env_batch_release(env_batch_t* eb);
+void					env_batch_reset(env_batch_t* eb, uint32 env);
+
+/* one key per environment, results gets the MOVE_RESULT flags of each. Undo and redo don't move */
+void					env_batch_step(env_batch_t* eb, const KEY* keys, uint8* results);
+
+/* copies an environment to b, which must be allocated with the level height */
+void					env_batch_board(const env_batch_t* eb, uint32 env, board_t* b);
+
+/*
+ * collection.c
+ */
+level_collection_t*		level_collection_load(const char* path);
+level_collection_t*		level_collection_parse(const char* text, size_t size);
+void					level_collection_release(level_collection_t* coll);
+/* the level rows as text, trailing blanks trimmed */
+void					level_write(FILE* f, const level_t* lvl);
+
+/*
+ * levelpack.c
+ *
+ * compiled level pack, every integer little endian whatever the host:
+ *	levelpack_header_t			(16 bytes, written and read field by field)
+ *	uint64 offsets[count + 1]	(payload i spans offsets[i]..offsets[i + 1])
+ *	payloads: uint16 width, uint16 height, then a nibble per cell (bg | actor << 2)
+ */
+#define LEVELPACK_MAGIC		"BWPK"
+
+enum {
+	LEVELPACK_VERSION	= 1,
+};
+
+typedef struct {
+	char		magic[4];
+	uint32		version;
+	uint32		count;
+	uint32		max_cells;		/* biggest width * height in the pack */
+} levelpack_header_t;
+
+typedef struct {
+	const uint8*	data;
+	size_t			size;
+	uint32			count;
+	uint32			max_cells;
+	const uint8*	offsets;		/* count + 1 little endian uint64 */
+} levelpack_t;
+
+levelpack_t*			levelpack_open(const char* path);
+void					levelpack_close(levelpack_t* pack);
+bool					levelpack_level(const levelpack_t* pack, uint32 index, level_t* lvl);
+bool					levelpack_write(const char* path, const level_collection_t* coll);
+
+/*
+ * store.c
+ *
+ * best solution of each level, kept across runs and looked up by the level
+ * fingerprint. The log is append only, little endian:
+ *	store_header_t
+ *	records: store_record_t, key_count keys packed 2 bits each (4 per byte),
+ *	         data_size bytes of analysis data, zero padded to 8 bytes
+ * A record is appended when it beats the best one of its level. An index
+ * file (path.idx) is kept next to the log; lookups go through the mapped
+ * files, nothing proportional to the store is allocated. One writer at a time.
+ */
+#define STORE_MAGIC			"BWSS"
+
+enum {
+	STORE_VERSION		= 1,
+};
+
+typedef struct {
+	char		magic[4];
+	uint32		version;
+} store_header_t;
+
+typedef struct {
+	uint64		fingerprint;
+	uint32		pushes;
+	uint32		moves;
+	uint32		key_count;
+	uint32		data_size;
+} store_record_t;
+
+typedef struct solution_store_s solution_store_t;
+
+/* hash of the level layout, never 0 */
+uint64					level_fingerprint(const level_t* lvl);
+
+/* creates the store when it doesn't exist */
+solution_store_t*		solution_store_open(const char* path);
+void					solution_store_close(solution_store_t* s);
+/* levels with a solution */
+uint32					solution_store_count(const solution_store_t* s);
+/* the best record of the level, NULL if there's none. Valid until the next solution_store_record */
+const store_record_t*	solution_store_find(const solution_store_t* s, uint64 fingerprint);
+/*
+ * keys are replayed on lvl and stored when they solve it with fewer pushes
+ * (then fewer moves) than the best record. data is optional
+ */
+bool					solution_store_record(solution_store_t* s, const level_t* lvl, const key_array_t* keys, const void* data, uint32 data_size);
+void					store_record_keys(const store_record_t* r, key_array_t* keys);
+const void*				store_record_data(const store_record_t* r);
+
+/*
+ * canon.c
+ *
+ * canonical level: the empty border trimmed, the player moved to the first
+ * square of its region and the smallest of the 8 rotations and mirrors, so
+ * copies, rotated and mirrored levels share one canonical fingerprint
+ */
+/* if out->cells is NULL it is allocated, otherwise it must hold width * height cells of lvl */
+bool					level_canonicalize(const level_t* lvl, level_t* out);
+/* level_fingerprint of the canonical level, 0 when it can't be built */
+uint64					level_canonical_fingerprint(const level_t* lvl);
+
+/*
+ * generator.c
+ *
+ * level candidates pulled back from their solved position, so they can
+ * always be solved. How hard they are is left to the caller to measure.
+ */
+typedef struct {
+	uint32		width;			/* room size, walls included */
+	uint32		height;
+	uint32		boxes;
+	uint32		wall_percent;	/* chance of an inner square becoming a wall */
+	uint32		pulls;			/* reverse moves played from the goals */
+} generator_params_t;
+
+generator_params_t		generator_default_params();
+/*
+ * one candidate drawn from seed, which moves on. false when the room came
+ * out too small or the boxes ended back on the goals. out->cells is
+ * allocated when NULL, otherwise it must hold width * height cells
+ */
+bool					level_generate(const generator_params_t* params, uint64* seed, level_t* out);
+
+/*
+ * lurd.c
+ *
+ * LURD solution checks: l, u, r, d walk and L, U, R, D push. The case is
+ * not checked, run lengths ("3l") and blanks are accepted.
+ */
+typedef enum {
+	LURD_SOLVED,
+	LURD_NOT_SOLVED,		/* every move was legal but boxes are left off goals */
+	LURD_ILLEGAL_MOVE,		/* a move ran into a wall or a blocked box */
+	LURD_BAD_MOVE,			/* a character that isn't a move */
+	LURD_INVALID_LEVEL,
+} LURD_RESULT;
+
+typedef struct {
+	LURD_RESULT		result;
+	uint32			moves;		/* moves played */
+	uint32			pushes;
+	uint32			error_at;	/* offset of the failing character, the length when there's none */
+} lurd_report_t;
+
+typedef struct {
+	const level_t*	level;
+	const char*		moves;
+	size_t			length;
+} lurd_job_t;
+
+/* plays moves on b, which is left in the last position reached. report is optional */
+LURD_RESULT				lurd_play(board_t* b, const char* moves, size_t len, lurd_report_t* report);
+LURD_RESULT				lurd_verify(const level_t* lvl, const char* moves, size_t len, lurd_report_t* report);
+
+/* checks count solutions on threads workers (the caller included), returns how many solve their level */
+uint32					lurd_verify_batch(const lurd_job_t* jobs, uint32 count, uint32 threads, lurd_report_t* reports);
+
+/* writes keys played from start as LURD, out holds keys->count + 1 chars. Returns the length */
+size_t					lurd_write(const board_t* start, const key_array_t* keys, char* out);
+const char*				lurd_result_string(LURD_RESULT res);
+
+/*
+ * deadlock.c
+ */
+typedef enum {
+	DEADLOCK_NONE,
+	DEADLOCK_DEAD_SQUARE,	/* the box can't reach any goal */
+	DEADLOCK_FREEZE,		/* a box off a goal can't move anymore */
+	DEADLOCK_CORRAL,		/* frozen boxes wall in an empty goal */
+} DEADLOCK;
+
+/* pattern cache, meant to be shared by all the levels of a collection and by several threads */
+typedef struct deadlock_cache_s deadlock_cache_t;
+
+deadlock_cache_t*		deadlock_cache_create(uint32 entries);
+void					deadlock_cache_release(deadlock_cache_t* cache);
+
+/*
+ * checks the board after the box at 'box' was pushed. reach is the player
+ * reach plane after the push, or NULL to compute it when it's needed. The
+ * cache is optional.
+ */
+DEADLOCK				deadlock_check(deadlock_cache_t* cache, const board_t* b, uint32 box, const uint64* reach);
+const char*				deadlock_string(DEADLOCK d);
+
+/*
+ * solver.c
+ */
+typedef enum {
+	SOLVER_SOLVED,
+	SOLVER_UNSOLVABLE,		/* the whole search space was explored */
+	SOLVER_OUT_OF_MEMORY,	/* the memory budget was exhausted */
+	SOLVER_TIMEOUT,
+	SOLVER_CANCELLED,
+	SOLVER_INVALID,			/* the level can't be converted to a board */
+} SOLVER_RESULT;
+
+typedef struct {
+	size_t				memory_budget;	/* bytes for nodes, open list and transposition table */
+	double				time_limit;		/* seconds, 0 for no limit */
+	uint32				weight;			/* heuristic weight, 1 finds push optimal solutions */
+	volatile uint32*	cancel;			/* optional, the search stops once it's non zero */
+	deadlock_cache_t*	deadlocks;		/* optional, prunes pushes into freeze and corral deadlocks */
+} solver_params_t;
+
+typedef struct {
+	SOLVER_RESULT	result;
+	uint64			expanded;
+	uint64			generated;
+	size_t			memory_used;	/* bytes the nodes, open list and table entries filled, at most memory_budget */
+	double			elapsed;
+	uint32			pushes;
+} solver_stats_t;
+
+solver_params_t			solver_default_params();
+SOLVER_RESULT			solver_solve(const level_t* lvl, const solver_params_t* params, key_array_t* solution, solver_stats_t* stats);
+SOLVER_RESULT			solver_solve_board(const board_t* b, const solver_params_t* params, key_array_t* solution, solver_stats_t* stats);
+const char*				solver_result_string(SOLVER_RESULT res);
+
+/*
+ * shared by the push searches of solver.c and psolver.c. Their nodes start
+ * with a solver_link_t, the push that led to them, and keep the box positions
+ * sorted.
+ */
+enum {
+	SOLVER_NO_NODE	= 0xFFFFFFFF,
+	SOLVER_DEAD		= 0xFFFFFFFF,	/* solver_root_boxes when a box can't reach any goal */
+};
+
+typedef struct {
+	uint32	parent;			/* SOLVER_NO_NODE for the root */
+	uint16	push_from;		/* box position before the push leading here */
+	uint8	push_dir;		/* KEY_UP..KEY_LEFT */
+	uint8	pad;
+} solver_link_t;
+
+/* the sorted box positions of b, returns the sum of their dist or SOLVER_DEAD */
+uint32					solver_root_boxes(const board_t* b, const uint16* dist, uint16* boxes);
+/* out gets boxes with boxes[moved] pushed to 'to', still sorted */
+void					solver_move_box(const uint16* boxes, uint32 count, uint32 moved, uint32 to, uint16* out);
+/* the moves from start to goal, nodes being stride bytes apart */
+bool					solver_build_solution(const board_t* start, const void* nodes, size_t stride, uint32 goal, key_array_t* solution);
+
+/*
+ * psolver.c
+ */
+SOLVER_RESULT			psolver_solve(const level_t* lvl, const solver_params_t* params, uint32 threads, key_array_t* solution, solver_stats_t* stats);
+SOLVER_RESULT			psolver_solve_board(const board_t* b, const solver_params_t* params, uint32 threads, key_array_t* solution, solver_stats_t* stats);
+
+/*
+ * hint.c
+ *
+ * next push hints searched on a worker thread while the game goes on. The
+ * game calls hint_request after every move and hint_latest every frame,
+ * neither of them waits on the worker: a new request cancels the search
+ * under way. The latency of a hint is bounded by the solver time limit.
+ */
+typedef enum {
+	HINT_PUSH,			/* push the box at 'box' towards 'dir' */
+	HINT_SOLVED,		/* no push left */
+	HINT_DEADLOCK,		/* the position can't be solved anymore */
+	HINT_UNKNOWN,		/* the search ran out of time or memory */
+} HINT_STATUS;
+
+typedef struct {
+	uint32			generation;		/* hint_request the hint answers */
+	HINT_STATUS		status;
+	uint32			box;
+	KEY				dir;
+	uint32			walk;			/* moves before the push */
+	uint32			pushes;			/* pushes left on the solution found */
+	double			latency;		/* seconds from the request to the hint */
+} hint_t;
+
+typedef struct hint_worker_s hint_worker_t;
+
+/* params->cancel is replaced by the worker's own flag */
+hint_worker_t*			hint_worker_create(const level_t* lvl, const solver_params_t* params);
+void					hint_worker_release(hint_worker_t* w);
+/* b is a position of the worker level. Returns the request generation */
+uint32					hint_request(hint_worker_t* w, const board_t* b);
+/* true when hint answers the last request. Otherwise hint gets an older hint, or is left untouched on a torn read */
+bool					hint_latest(const hint_worker_t* w, hint_t* hint);
+const char*				hint_status_string(HINT_STATUS status);
+
 
 #endif // BOXWORLD_H
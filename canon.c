@@ -0,0 +1,233 @@
+/*
+** BoxWorld Copyright 2016(c) Wael El Oraiby. All Rights Reserved
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** Under Section 7 of GPL version 3, you are granted additional
+** permissions described in the GCC Runtime Library Exception, version
+** 3.1, as published by the Free Software Foundation.
+**
+** You should have received a copy of the GNU General Public License and
+** a copy of the GCC Runtime Library Exception along with this program;
+** see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+** <http://www.gnu.org/licenses/>.
+**
+*/
+#include "boxworld.h"
+
+/*
+ * canonical levels. The empty border is trimmed, the player is taken off its
+ * square and the squares it can walk to (boxes block) are marked as its
+ * region. Each of the 8 symmetries is then read in row order, the player
+ * standing on the first region square met, and the smallest reading (size
+ * first, then a nibble per cell) is the canonical level.
+ *
+ * symmetry bits: 1 transposes, 2 mirrors x, 4 mirrors y, applied to the
+ * output coordinates in the opposite order
+ */
+
+enum {
+	SYM_TRANSPOSE	= 1,
+	SYM_MIRROR_X	= 2,
+	SYM_MIRROR_Y	= 4,
+	SYM_COUNT		= 8,
+};
+
+typedef struct {
+	uint32			width;
+	uint32			height;
+	cell_t*			cells;		/* trimmed, without the player */
+	uint8*			region;		/* squares the player can walk to */
+} canon_t;
+
+static INLINE uint32
+cell_code(cell_t c) {
+	return (uint32)(c.bg & 3) | ((uint32)(c.actor & 3) << 2);
+}
+
+/* index in the trimmed level of cell (x, y) of its sym orientation */
+static INLINE uint32
+sym_index(const canon_t* c, uint32 sym, uint32 x, uint32 y) {
+	uint32	w	= (sym & SYM_TRANSPOSE) ? c->height : c->width;
+	uint32	h	= (sym & SYM_TRANSPOSE) ? c->width : c->height;
+	uint32	sx	= (sym & SYM_MIRROR_X) ? w - 1 - x : x;
+	uint32	sy	= (sym & SYM_MIRROR_Y) ? h - 1 - y : y;
+
+	return (sym & SYM_TRANSPOSE) ? sx * c->width + sy : sy * c->width + sx;
+}
+
+/* first region square of the sym orientation, in its row order. count when there's no player */
+static uint32
+sym_player(const canon_t* c, uint32 sym) {
+	uint32	w		= (sym & SYM_TRANSPOSE) ? c->height : c->width;
+	uint32	count	= c->width * c->height;
+	uint32	i;
+
+	for( i = 0; i < count; ++i ) {
+		if( c->region[sym_index(c, sym, i % w, i / w)] ) {
+			break;
+		}
+	}
+	return i;
+}
+
+/* <0, 0, >0 as the reading of orientation a compares to b's */
+static int
+sym_compare(const canon_t* c, uint32 a, uint32 pa, uint32 b, uint32 pb) {
+	uint32	wa		= (a & SYM_TRANSPOSE) ? c->height : c->width;
+	uint32	wb		= (b & SYM_TRANSPOSE) ? c->height : c->width;
+	uint32	count	= c->width * c->height;
+	uint32	i;
+
+	if( wa != wb ) {
+		return wa < wb ? -1 : 1;
+	}
+
+	for( i = 0; i < count; ++i ) {
+		uint32	ca	= cell_code(c->cells[sym_index(c, a, i % wa, i / wa)]) | (i == pa ? ACT_PLAYER << 2 : 0);
+		uint32	cb	= cell_code(c->cells[sym_index(c, b, i % wb, i / wb)]) | (i == pb ? ACT_PLAYER << 2 : 0);
+
+		if( ca != cb ) {
+			return ca < cb ? -1 : 1;
+		}
+	}
+	return 0;
+}
+
+static void
+mark_region(canon_t* c, uint32 player, uint32* stack) {
+	uint32	w		= c->width;
+	uint32	count	= c->width * c->height;
+	uint32	top		= 0;
+
+	memset(c->region, 0, count);
+	c->region[player]	= 1;
+	stack[top++]		= player;
+
+	while( top ) {
+		uint32	p	= stack[--top];
+		uint32	x	= p % w;
+		uint32	n[4];
+		uint32	k, nc = 0;
+
+		if( x > 0 )				n[nc++]	= p - 1;
+		if( x + 1 < w )			n[nc++]	= p + 1;
+		if( p >= w )			n[nc++]	= p - w;
+		if( p + w < count )		n[nc++]	= p + w;
+
+		for( k = 0; k < nc; ++k ) {
+			cell_t	cl	= c->cells[n[k]];
+			if( !c->region[n[k]] && (BG_GROUND == cl.bg || BG_PLACE == cl.bg) && ACT_BOX != cl.actor ) {
+				c->region[n[k]]	= 1;
+				stack[top++]	= n[k];
+			}
+		}
+	}
+}
+
+bool
+level_canonicalize(const level_t* lvl, level_t* out) {
+	canon_t		c;
+	uint8*		scratch;
+	uint32		x0 = lvl->width, y0 = lvl->height, x1 = 0, y1 = 0;
+	uint32		player	= 0;
+	bool		has_player	= false;
+	uint32		best, best_player;
+	uint32		x, y, s, count, w;
+
+	for( y = 0; y < lvl->height; ++y ) {
+		for( x = 0; x < lvl->width; ++x ) {
+			if( BG_EMPTY != lvl->cells[y * lvl->width + x].bg ) {
+				x0	= MIN(x0, x);
+				y0	= MIN(y0, y);
+				x1	= MAX(x1, x + 1);
+				y1	= MAX(y1, y + 1);
+			}
+		}
+	}
+
+	c.width		= x1 > x0 ? x1 - x0 : 0;
+	c.height	= y1 > y0 ? y1 - y0 : 0;
+	count		= c.width * c.height;
+
+	if( NULL == out->cells ) {
+		out->cells	= (cell_t*)malloc(sizeof(cell_t) * MAX(count, 1));
+		if( NULL == out->cells ) {
+			boxworld_error(NOT_ENOUGH_MEMORY, "level_canonicalize: not enough memory");
+			return false;
+		}
+	}
+
+	out->width	= c.width;
+	out->height	= c.height;
+	if( 0 == count ) {
+		return true;
+	}
+
+	/* trimmed cells, the flood stack, then the region flags */
+	scratch	= (uint8*)malloc((sizeof(cell_t) + sizeof(uint32) + 1) * (size_t)count);
+	if( NULL == scratch ) {
+		boxworld_error(NOT_ENOUGH_MEMORY, "level_canonicalize: not enough memory");
+		return false;
+	}
+	c.cells		= (cell_t*)scratch;
+	c.region	= scratch + (sizeof(cell_t) + sizeof(uint32)) * count;
+
+	for( y = 0; y < c.height; ++y ) {
+		for( x = 0; x < c.width; ++x ) {
+			cell_t	cl	= lvl->cells[(y + y0) * lvl->width + x + x0];
+			if( ACT_PLAYER == cl.actor ) {
+				player		= y * c.width + x;
+				has_player	= true;
+				cl.actor	= ACT_NONE;
+			}
+			c.cells[y * c.width + x]	= cl;
+		}
+	}
+
+	if( has_player ) {
+		mark_region(&c, player, (uint32*)(void*)(scratch + sizeof(cell_t) * count));
+	} else {
+		memset(c.region, 0, count);
+	}
+
+	best		= 0;
+	best_player	= sym_player(&c, 0);
+	for( s = 1; s < SYM_COUNT; ++s ) {
+		uint32	p	= sym_player(&c, s);
+		if( sym_compare(&c, s, p, best, best_player) < 0 ) {
+			best		= s;
+			best_player	= p;
+		}
+	}
+
+	w			= (best & SYM_TRANSPOSE) ? c.height : c.width;
+	out->width	= w;
+	out->height	= count / w;
+	for( s = 0; s < count; ++s ) {
+		out->cells[s]	= c.cells[sym_index(&c, best, s % w, s / w)];
+		if( s == best_player ) {
+			out->cells[s].actor	= ACT_PLAYER;
+		}
+	}
+
+	free(scratch);
+	return true;
+}
+
+uint64
+level_canonical_fingerprint(const level_t* lvl) {
+	level_t		canon	= { 0, 0, NULL };
+	uint64		h;
+
+	if( !level_canonicalize(lvl, &canon) ) {
+		return 0;
+	}
+
+	h	= level_fingerprint(&canon);
+	free(canon.cells);
+	return h;
+}
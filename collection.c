@@ -0,0 +1,548 @@
+/*
+** BoxWorld Copyright 2016(c) Wael El Oraiby. All Rights Reserved
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** Under Section 7 of GPL version 3, you are granted additional
+** permissions described in the GCC Runtime Library Exception, version
+** 3.1, as published by the Free Software Foundation.
+**
+** You should have received a copy of the GNU General Public License and
+** a copy of the GCC Runtime Library Exception along with this program;
+** see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+** <http://www.gnu.org/licenses/>.
+**
+*/
+#include "boxworld.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <strings.h>
+
+/*
+ * .xsb/.sok reader: rows are made of "#@+$*. -_" with optional run length
+ * digits and '|' as an inline row separator. Any other line (titles,
+ * comments, solutions) ends the current level.
+ *
+ * A "Solution" line after a level starts its reference solution: the LURD
+ * moves following the ':' and on the next lines, up to the first line that
+ * isn't made of moves. Run lengths are expanded, only the first solution of
+ * a level is kept.
+ */
+
+/* one row of the level being parsed, points into the source text */
+typedef struct {
+	const char*	start;
+	const char*	end;
+} row_t;
+
+ARRAY_TYPE(row_array, row_t)
+ARRAY_TYPE(index_array, uint32)
+ARRAY_TYPE(char_array, char)
+
+typedef struct {
+	uint32	level;
+	uint32	start;		/* offset in the solution text */
+} solution_t;
+
+ARRAY_TYPE(solution_array, solution_t)
+
+typedef struct {
+	level_t*	levels;
+	uint32		level_count;
+	uint32		level_max;
+
+	cell_t*		cells;
+	size_t		cell_count;
+	size_t		cell_max;
+
+	row_array_t		rows;
+	index_array_t	stack;
+	uint8*			seen;
+	uint32			seen_max;
+
+	char_array_t		text;			/* nul terminated solutions */
+	solution_array_t	solutions;
+	bool				in_solution;	/* move lines extend the last solution */
+} parser_t;
+
+enum {
+	CH_LEVEL	= 1,	/* allowed in a level row */
+	CH_WALL		= 2,
+	CH_DIGIT	= 4,
+	CH_MOVE		= 8,	/* allowed in a solution line */
+};
+
+static uint8	char_class[256];
+
+static void
+init_char_class() {
+	const char*	c;
+
+	if( char_class['l'] ) {
+		return;
+	}
+
+	for( c = "#@+$*. -_|"; *c; ++c ) {
+		char_class[(uint8)*c]	= CH_LEVEL;
+	}
+
+	for( c = "0123456789"; *c; ++c ) {
+		char_class[(uint8)*c]	= CH_LEVEL | CH_DIGIT;
+	}
+
+	char_class['#']	|= CH_WALL;
+
+	for( c = "lurdLURD0123456789 \t"; *c; ++c ) {
+		char_class[(uint8)*c]	|= CH_MOVE;
+	}
+}
+
+/* returns the end of the line if it's a level row, NULL otherwise */
+static const char*
+scan_row(const char* line, const char* end, bool* has_wall) {
+	const char*	c;
+	uint8		acc	= 0;
+
+	for( c = line; c < end && *c != '\n' && *c != '\r'; ++c ) {
+		uint8	cls	= char_class[(uint8)*c];
+		if( !(cls & CH_LEVEL) ) {
+			return NULL;
+		}
+		acc	|= cls;
+	}
+
+	*has_wall	= (acc & CH_WALL) != 0;
+	return c;
+}
+
+/*
+ * expanded width of a row (run lengths applied), BOARD_MAX_WIDTH + 1 once it
+ * is past what a board takes: runs and width are clamped as they are read,
+ * so a huge run count can neither wrap nor size the row
+ */
+static uint32
+row_width(const row_t* r) {
+	const char*	c;
+	uint32		w	= 0;
+	uint32		n	= 0;
+
+	for( c = r->start; c < r->end; ++c ) {
+		if( char_class[(uint8)*c] & CH_DIGIT ) {
+			n	= MIN(n * 10 + (uint32)(*c - '0'), BOARD_MAX_WIDTH + 1);
+		} else {
+			w	= MIN(w + (n ? n : 1), BOARD_MAX_WIDTH + 1);
+			n	= 0;
+		}
+	}
+	return w;
+}
+
+static cell_t
+char_to_cell(char ch) {
+	cell_t	c;
+
+	switch( ch ) {
+	case '#'	: c.bg = BG_WALL;	c.actor = ACT_NONE;		break;
+	case '.'	: c.bg = BG_PLACE;	c.actor = ACT_NONE;		break;
+	case '$'	: c.bg = BG_GROUND;	c.actor = ACT_BOX;		break;
+	case '*'	: c.bg = BG_PLACE;	c.actor = ACT_BOX;		break;
+	case '@'	: c.bg = BG_GROUND;	c.actor = ACT_PLAYER;	break;
+	case '+'	: c.bg = BG_PLACE;	c.actor = ACT_PLAYER;	break;
+	default		: c.bg = BG_GROUND;	c.actor = ACT_NONE;		break;
+	}
+	return c;
+}
+
+/* ground that can't be reached from the player is outside the level */
+static bool
+mark_outside(parser_t* p, level_t* lvl) {
+	uint32		i;
+	uint32		w		= lvl->width;
+	uint32		count	= lvl->width * lvl->height;
+	cell_t*		cells	= lvl->cells;
+	uint8*		seen;
+
+	if( count > p->seen_max ) {
+		seen	= (uint8*)realloc(p->seen, count);
+		if( NULL == seen ) {
+			boxworld_error(NOT_ENOUGH_MEMORY, "level_collection_parse: not enough memory");
+			return false;
+		}
+		p->seen		= seen;
+		p->seen_max	= count;
+	}
+
+	seen	= p->seen;
+	memset(seen, 0, count);
+
+	p->stack.count	= 0;
+	for( i = 0; i < count; ++i ) {
+		if( cells[i].actor == ACT_PLAYER ) {
+			seen[i]	= 1;
+			index_array_push(&(p->stack), i);
+		}
+	}
+
+	while( p->stack.count ) {
+		uint32	c	= index_array_pop(&(p->stack));
+		uint32	x	= c % w;
+		uint32	n[4];
+		uint32	k, nc = 0;
+
+		if( x > 0 )				n[nc++]	= c - 1;
+		if( x + 1 < w )			n[nc++]	= c + 1;
+		if( c >= w )			n[nc++]	= c - w;
+		if( c + w < count )		n[nc++]	= c + w;
+
+		for( k = 0; k < nc; ++k ) {
+			if( !seen[n[k]] && cells[n[k]].bg != BG_WALL ) {
+				seen[n[k]]	= 1;
+				index_array_push(&(p->stack), n[k]);
+			}
+		}
+	}
+
+	for( i = 0; i < count; ++i ) {
+		if( !seen[i] && cells[i].bg == BG_GROUND && cells[i].actor == ACT_NONE ) {
+			cells[i].bg	= BG_EMPTY;
+		}
+	}
+
+	return true;
+}
+
+static bool
+flush_level(parser_t* p) {
+	uint32		width	= 0;
+	uint32		height	= (uint32)p->rows.count;
+	uint32		r;
+	size_t		needed;
+	level_t*	lvl;
+	cell_t*		cells;
+
+	if( 0 == height ) {
+		return true;
+	}
+
+	for( r = 0; r < height; ++r ) {
+		width	= MAX(width, row_width(&(p->rows.array[r])));
+	}
+
+	if( width > BOARD_MAX_WIDTH ) {
+		boxworld_error(UNSUPPORTED, "level_collection_parse: level is too wide");
+		return false;
+	}
+
+	needed	= p->cell_count + (size_t)width * height;
+	if( needed > p->cell_max ) {
+		size_t	max	= p->cell_max ? p->cell_max : 4096;
+		while( max < needed ) {
+			max	<<= 1;
+		}
+
+		cells	= (cell_t*)realloc(p->cells, sizeof(cell_t) * max);
+		if( NULL == cells ) {
+			boxworld_error(NOT_ENOUGH_MEMORY, "level_collection_parse: not enough memory");
+			return false;
+		}
+		p->cells	= cells;
+		p->cell_max	= max;
+	}
+
+	if( p->level_count == p->level_max ) {
+		uint32		max	= p->level_max ? p->level_max << 1 : 64;
+		level_t*	lv	= (level_t*)realloc(p->levels, sizeof(level_t) * max);
+		if( NULL == lv ) {
+			boxworld_error(NOT_ENOUGH_MEMORY, "level_collection_parse: not enough memory");
+			return false;
+		}
+		p->levels		= lv;
+		p->level_max	= max;
+	}
+
+	lvl			= &(p->levels[p->level_count++]);
+	lvl->width	= width;
+	lvl->height	= height;
+	lvl->cells	= p->cells + p->cell_count;		/* fixed up once the storage stops moving */
+
+	cells		= lvl->cells;
+	for( r = 0; r < height; ++r ) {
+		const char*	c;
+		uint32		x	= 0;
+		uint32		n	= 0;
+
+		for( c = p->rows.array[r].start; c < p->rows.array[r].end; ++c ) {
+			if( char_class[(uint8)*c] & CH_DIGIT ) {
+				n	= n * 10 + (uint32)(*c - '0');
+			} else {
+				cell_t	cell	= char_to_cell(*c);
+				uint32	k		= n ? n : 1;
+				while( k-- ) {
+					cells[x++]	= cell;
+				}
+				n	= 0;
+			}
+		}
+
+		for( ; x < width; ++x ) {
+			cells[x].bg		= BG_EMPTY;
+			cells[x].actor	= ACT_NONE;
+		}
+		cells	+= width;
+	}
+
+	if( !mark_outside(p, lvl) ) {
+		return false;
+	}
+
+	p->cell_count	= needed;
+	p->rows.count	= 0;
+	return true;
+}
+
+/* appends the moves in [c, end), returns false on any other character */
+static bool
+append_moves(parser_t* p, const char* c, const char* end) {
+	const char*	m;
+	uint32		n	= 0;
+
+	for( m = c; m < end; ++m ) {
+		if( !(char_class[(uint8)*m] & CH_MOVE) ) {
+			return false;
+		}
+	}
+
+	char_array_pop(&(p->text));		/* the terminator */
+	for( ; c < end; ++c ) {
+		if( char_class[(uint8)*c] & CH_DIGIT ) {
+			n	= n * 10 + (uint32)(*c - '0');
+		} else if( *c != ' ' && *c != '\t' ) {
+			uint32	k	= n ? n : 1;
+			while( k-- ) {
+				char_array_push(&(p->text), *c);
+			}
+			n	= 0;
+		}
+	}
+	char_array_push(&(p->text), '\0');
+	return true;
+}
+
+static void
+scan_solution(parser_t* p, const char* c, const char* end) {
+	const char*	s	= c;
+
+	while( s < end && (*s == ' ' || *s == '\t') ) {
+		++s;
+	}
+
+	if( end - s >= 8 && 0 == strncasecmp(s, "solution", 8) ) {
+		const char*	colon	= (const char*)memchr(s, ':', (size_t)(end - s));
+		uint32		level	= p->level_count - 1;
+
+		p->in_solution	= false;
+		if( 0 == p->level_count ||
+			(p->solutions.count && p->solutions.array[p->solutions.count - 1].level == level) ) {
+			return;
+		}
+
+		{
+			solution_t	sol	= { level, (uint32)p->text.count };
+			solution_array_push(&(p->solutions), sol);
+			char_array_push(&(p->text), '\0');
+		}
+
+		p->in_solution	= true;
+		if( colon ) {
+			p->in_solution	= append_moves(p, colon + 1, end);
+		}
+	} else if( p->in_solution ) {
+		p->in_solution	= s < end && append_moves(p, s, end);
+	}
+}
+
+level_collection_t*
+level_collection_parse(const char* text, size_t size) {
+	parser_t			p;
+	const char*			c		= text;
+	const char*			end		= text + size;
+	level_collection_t*	coll	= NULL;
+	size_t				offset	= 0;
+	uint32				l;
+
+	init_char_class();
+
+	memset(&p, 0, sizeof(parser_t));
+	p.rows	= row_array_new();
+	p.stack	= index_array_new();
+	p.text		= char_array_new();
+	p.solutions	= solution_array_new();
+
+	while( c < end ) {
+		bool		has_wall	= false;
+		const char*	eol			= scan_row(c, end, &has_wall);
+
+		if( eol && has_wall ) {
+			/* split the line on '|' */
+			const char*	s	= c;
+			const char*	e;
+			for( e = c; e <= eol; ++e ) {
+				if( e == eol || *e == '|' ) {
+					row_t	r	= { s, e };
+					row_array_push(&(p.rows), r);
+					s	= e + 1;
+				}
+			}
+			c	= eol;
+			p.in_solution	= false;
+		} else {
+			if( !flush_level(&p) ) {
+				goto failed;
+			}
+
+			if( NULL == eol ) {
+				eol	= (const char*)memchr(c, '\n', (size_t)(end - c));
+				eol	= eol ? eol : end;
+			}
+
+			scan_solution(&p, c, (eol > c && eol[-1] == '\r') ? eol - 1 : eol);
+			c	= eol;
+		}
+
+		/* skip the line terminator, a blank line must still end the level */
+		if( c < end && *c == '\r' ) {
+			++c;
+		}
+		if( c < end && *c == '\n' ) {
+			++c;
+		}
+	}
+
+	if( !flush_level(&p) ) {
+		goto failed;
+	}
+
+	coll	= (level_collection_t*)malloc(sizeof(level_collection_t));
+	if( NULL == coll ) {
+		boxworld_error(NOT_ENOUGH_MEMORY, "level_collection_parse: not enough memory");
+		goto failed;
+	}
+
+	coll->solutions	= (const char**)calloc(MAX(p.level_count, 1), sizeof(const char*));
+	if( NULL == coll->solutions ) {
+		free(coll);
+		boxworld_error(NOT_ENOUGH_MEMORY, "level_collection_parse: not enough memory");
+		goto failed;
+	}
+
+	for( l = 0; l < p.solutions.count; ++l ) {
+		coll->solutions[p.solutions.array[l].level]	= p.text.array + p.solutions.array[l].start;
+	}
+
+	/* the cell storage may have moved while growing */
+	for( l = 0; l < p.level_count; ++l ) {
+		p.levels[l].cells	= p.cells + offset;
+		offset	+= (size_t)p.levels[l].width * p.levels[l].height;
+	}
+
+	coll->count		= p.level_count;
+	coll->levels	= p.levels;
+	coll->cells		= p.cells;
+	coll->solution_text	= p.text.array;		/* owned by the collection now */
+
+	row_array_release(&(p.rows));
+	index_array_release(&(p.stack));
+	solution_array_release(&(p.solutions));
+	free(p.seen);
+	return coll;
+
+failed:
+	row_array_release(&(p.rows));
+	index_array_release(&(p.stack));
+	char_array_release(&(p.text));
+	solution_array_release(&(p.solutions));
+	free(p.seen);
+	free(p.levels);
+	free(p.cells);
+	return NULL;
+}
+
+level_collection_t*
+level_collection_load(const char* path) {
+	int					fd;
+	struct stat			st;
+	void*				text;
+	level_collection_t*	coll;
+	char				error_buff[MAX_ERROR_LENGTH]	= {0};
+
+	fd	= open(path, O_RDONLY);
+	if( fd < 0 ) {
+		snprintf(error_buff, MAX_ERROR_LENGTH, "level_collection_load: %s not found", path);
+		return (level_collection_t*)boxworld_error(FILE_NOT_FOUND, error_buff);
+	}
+
+	if( fstat(fd, &st) != 0 ) {
+		close(fd);
+		snprintf(error_buff, MAX_ERROR_LENGTH, "level_collection_load: unable to stat %s", path);
+		return (level_collection_t*)boxworld_error(LOAD_FAILED, error_buff);
+	}
+
+	if( 0 == st.st_size ) {
+		close(fd);
+		return level_collection_parse("", 0);
+	}
+
+	text	= mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if( MAP_FAILED == text ) {
+		snprintf(error_buff, MAX_ERROR_LENGTH, "level_collection_load: unable to map %s", path);
+		return (level_collection_t*)boxworld_error(LOAD_FAILED, error_buff);
+	}
+
+	posix_madvise(text, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+
+	coll	= level_collection_parse((const char*)text, (size_t)st.st_size);
+
+	munmap(text, (size_t)st.st_size);
+	return coll;
+}
+
+void
+level_collection_release(level_collection_t* coll) {
+	free(coll->levels);
+	free(coll->cells);
+	free(coll->solutions);
+	free(coll->solution_text);
+	free(coll);
+}
+
+void
+level_write(FILE* f, const level_t* lvl) {
+	static const char	chars[4][3]	= {
+		/* ACT_NONE, ACT_PLAYER, ACT_BOX */
+		{ ' ', ' ', ' ' },		/* BG_EMPTY */
+		{ '#', '#', '#' },		/* BG_WALL */
+		{ ' ', '@', '$' },		/* BG_GROUND */
+		{ '.', '+', '*' },		/* BG_PLACE */
+	};
+	uint32	x, y;
+
+	for( y = 0; y < lvl->height; ++y ) {
+		const cell_t*	row	= lvl->cells + y * lvl->width;
+		uint32			end	= lvl->width;
+
+		while( end > 0 && ' ' == chars[row[end - 1].bg & 3][row[end - 1].actor % 3] ) {
+			--end;
+		}
+		for( x = 0; x < end; ++x ) {
+			fputc(chars[row[x].bg & 3][row[x].actor % 3], f);
+		}
+		fputc('\n', f);
+	}
+}
@@ -0,0 +1,48 @@
+/*
+** BoxWorld Copyright 2016(c) Wael El Oraiby. All Rights Reserved
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** Under Section 7 of GPL version 3, you are granted additional
+** permissions described in the GCC Runtime Library Exception, version
+** 3.1, as published by the Free Software Foundation.
+**
+** You should have received a copy of the GNU General Public License and
+** a copy of the GCC Runtime Library Exception along with this program;
+** see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+** <http://www.gnu.org/licenses/>.
+**
+*/
+#include "boxworld.h"
+#include <time.h>
+
+/* per thread, so the headless tools can load and check levels concurrently */
+static __thread char			bworld_error_string[MAX_ERROR_LENGTH]	= {0};
+static __thread BOXWORLD_ERROR	bworld_error							= NO_ERROR;
+
+void*
+boxworld_error(BOXWORLD_ERROR err, const char* string) {
+	size_t sl		= strlen(string);
+
+	if( sl >= MAX_ERROR_LENGTH ) {
+		exit(1);
+	}
+
+	bworld_error	= err;
+	memcpy(bworld_error_string, string, sl + 1);
+
+	return NULL;
+}
+
+BOXWORLD_ERROR		boxworld_error_number()	{ return bworld_error; }
+extern const char*	boxworld_error_string()	{ return bworld_error_string; }
+
+double
+boxworld_seconds() {
+	struct timespec	ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
@@ -0,0 +1,330 @@
+/*
+** BoxWorld Copyright 2016(c) Wael El Oraiby. All Rights Reserved
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** Under Section 7 of GPL version 3, you are granted additional
+** permissions described in the GCC Runtime Library Exception, version
+** 3.1, as published by the Free Software Foundation.
+**
+** You should have received a copy of the GNU General Public License and
+** a copy of the GCC Runtime Library Exception along with this program;
+** see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+** <http://www.gnu.org/licenses/>.
+**
+*/
+#include "boxworld.h"
+
+/*
+ * dynamic deadlocks after a push.
+ *
+ * Freeze: a box is frozen when it's blocked on both axes; an axis is blocked
+ * by a wall on either side, by dead squares on both sides, or by a box on
+ * either side that is frozen itself (the first box standing in for a wall).
+ * A frozen box off a goal is a deadlock. The analysis only looks at the 5x5
+ * window around the pushed box, whatever lies outside is taken as free
+ * floor, so it can miss deadlocks but never reports a false one. The window
+ * doesn't depend on where it is in the level, so its result is cached by
+ * content and reused by every level sharing the cache.
+ *
+ * Corral: when the pushed box is frozen, the floor it cuts from the player is
+ * flooded. If every box around that area is frozen too nothing can ever get
+ * in or out, so an empty goal inside is a deadlock.
+ */
+
+enum {
+	WINDOW_SIZE		= 5,
+	WINDOW_HALF		= WINDOW_SIZE / 2,
+	WINDOW_MASK		= (1 << WINDOW_SIZE) - 1,
+	GRID_STRIDE		= WINDOW_SIZE + 2,		/* the window plus a ring of unknown floor */
+	GRID_CELLS		= GRID_STRIDE * GRID_STRIDE,
+	GRID_CENTER		= GRID_STRIDE * (WINDOW_HALF + 1) + WINDOW_HALF + 1,
+
+	CELL_FLOOR		= 0,
+	CELL_WALL		= 1 << 0,
+	CELL_BOX		= 1 << 1,
+	CELL_GOAL		= 1 << 2,
+	CELL_DEAD		= 1 << 3,
+
+	/* cached results */
+	PATTERN_FROZEN		= 1 << 0,	/* the center box is frozen */
+	PATTERN_DEADLOCK	= 1 << 1,	/* a frozen box of the window is off a goal */
+	PATTERN_VALID		= 1 << 2,
+	PATTERN_BITS		= 3,
+};
+
+struct deadlock_cache_s {
+	volatile uint64*	entries;	/* key hash with the result in the low bits, 0 when empty */
+	uint32				mask;
+};
+
+/* 5x5 window contents, one 25 bit mask per plane */
+typedef struct {
+	uint32	walls;
+	uint32	boxes;
+	uint32	goals;
+	uint32	dead;
+} window_t;
+
+deadlock_cache_t*
+deadlock_cache_create(uint32 entries) {
+	deadlock_cache_t*	cache;
+	uint32				size	= 1024;
+
+	while( size < entries && size < 0x80000000u ) {
+		size	<<= 1;
+	}
+
+	cache	= (deadlock_cache_t*)malloc(sizeof(deadlock_cache_t));
+	if( NULL == cache ) {
+		return (deadlock_cache_t*)boxworld_error(NOT_ENOUGH_MEMORY, "deadlock_cache_create: not enough memory");
+	}
+
+	cache->entries	= (volatile uint64*)calloc(size, sizeof(uint64));
+	cache->mask		= size - 1;
+	if( NULL == cache->entries ) {
+		free(cache);
+		return (deadlock_cache_t*)boxworld_error(NOT_ENOUGH_MEMORY, "deadlock_cache_create: not enough memory");
+	}
+
+	return cache;
+}
+
+void
+deadlock_cache_release(deadlock_cache_t* cache) {
+	if( cache ) {
+		free((void*)cache->entries);
+		free(cache);
+	}
+}
+
+static uint32
+row_bits(const uint64* plane, uint32 y, uint32 x) {
+	uint64	row	= plane[y];
+	row	= x >= WINDOW_HALF ? row >> (x - WINDOW_HALF) : row << (WINDOW_HALF - x);
+	return (uint32)row & WINDOW_MASK;
+}
+
+static void
+read_window(const board_t* b, uint32 pos, window_t* w) {
+	uint32	x	= board_x(pos);
+	uint32	y	= board_y(pos);
+	uint32	r;
+
+	memset(w, 0, sizeof(window_t));
+	for( r = 0; r < WINDOW_SIZE; ++r ) {
+		uint32	ry		= y + r - WINDOW_HALF;		/* wraps to a huge value above the board */
+		uint32	shift	= r * WINDOW_SIZE;
+
+		if( ry >= b->height ) {
+			w->walls	|= (uint32)WINDOW_MASK << shift;
+			continue;
+		}
+
+		w->walls	|= (~row_bits(b->floor, ry, x) & WINDOW_MASK) << shift;
+		w->boxes	|= row_bits(b->boxes, ry, x) << shift;
+		w->goals	|= row_bits(b->goals, ry, x) << shift;
+		w->dead		|= row_bits(b->dead, ry, x) << shift;
+	}
+}
+
+static uint64
+window_hash(const window_t* w) {
+	uint64	a	= (uint64)w->walls | ((uint64)w->boxes << 25);
+	uint64	c	= (uint64)w->goals | ((uint64)w->dead << 25);
+	uint64	z	= a * 0x9E3779B97F4A7C15ull ^ (c + 0x632BE59BD9B4E019ull) * 0xC2B2AE3D27D4EB4Full;
+	z	= (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z	= (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+static bool frozen(uint8* grid, uint32 p);
+
+static bool
+axis_blocked(uint8* grid, uint32 p, uint32 d) {
+	uint8	a	= grid[p - d];
+	uint8	b	= grid[p + d];
+
+	if( (a & CELL_WALL) || (b & CELL_WALL) ) {
+		return true;
+	}
+	if( (a & CELL_DEAD) && (b & CELL_DEAD) ) {
+		return true;
+	}
+	return ((a & CELL_BOX) && frozen(grid, p - d)) || ((b & CELL_BOX) && frozen(grid, p + d));
+}
+
+/* the box at p stands in for a wall while its neighbours are checked */
+static bool
+frozen(uint8* grid, uint32 p) {
+	uint8	saved	= grid[p];
+	bool	res;
+
+	grid[p]	= CELL_WALL;
+	res		= axis_blocked(grid, p, 1) && axis_blocked(grid, p, GRID_STRIDE);
+	grid[p]	= saved;
+	return res;
+}
+
+static uint32
+analyze_window(const window_t* w) {
+	uint8	grid[GRID_CELLS];
+	uint32	res	= PATTERN_VALID;
+	uint32	r, c;
+
+	memset(grid, CELL_FLOOR, sizeof(grid));
+	for( r = 0; r < WINDOW_SIZE; ++r ) {
+		for( c = 0; c < WINDOW_SIZE; ++c ) {
+			uint32	bit	= 1u << (r * WINDOW_SIZE + c);
+			uint8	v	= CELL_FLOOR;
+
+			v	|= (w->walls & bit) ? CELL_WALL : 0;
+			v	|= (w->boxes & bit) ? CELL_BOX : 0;
+			v	|= (w->goals & bit) ? CELL_GOAL : 0;
+			v	|= (w->dead & bit) ? CELL_DEAD : 0;
+			grid[(r + 1) * GRID_STRIDE + c + 1]	= v;
+		}
+	}
+
+	if( frozen(grid, GRID_CENTER) ) {
+		res	|= PATTERN_FROZEN;
+	}
+
+	for( r = 0; r < WINDOW_SIZE && !(res & PATTERN_DEADLOCK); ++r ) {
+		for( c = 0; c < WINDOW_SIZE; ++c ) {
+			uint32	p	= (r + 1) * GRID_STRIDE + c + 1;
+			if( (grid[p] & CELL_BOX) && !(grid[p] & CELL_GOAL) && frozen(grid, p) ) {
+				res	|= PATTERN_DEADLOCK;
+				break;
+			}
+		}
+	}
+
+	return res;
+}
+
+/* window analysis of the box at pos, from the cache when it's there */
+static uint32
+pattern_lookup(deadlock_cache_t* cache, const board_t* b, uint32 pos) {
+	window_t	w;
+	uint64		hash;
+	uint64		entry;
+	uint32		i, probe;
+	uint32		res;
+
+	read_window(b, pos, &w);
+	hash	= window_hash(&w) & ~(uint64)((1 << PATTERN_BITS) - 1);
+
+	if( NULL == cache ) {
+		return analyze_window(&w);
+	}
+
+	i	= (uint32)(hash >> 32) & cache->mask;
+	for( probe = 0; probe < 4; ++probe ) {
+		entry	= cache->entries[(i + probe) & cache->mask];
+		if( 0 == entry ) {
+			break;
+		}
+		if( (entry & ~(uint64)((1 << PATTERN_BITS) - 1)) == hash ) {
+			return (uint32)entry & ((1 << PATTERN_BITS) - 1);
+		}
+	}
+
+	/* one 64 bit store per entry, so concurrent readers never see half an entry */
+	res	= analyze_window(&w);
+	cache->entries[(i + MIN(probe, 3)) & cache->mask]	= hash | res;
+	return res;
+}
+
+static bool
+corral_deadlock(deadlock_cache_t* cache, const board_t* b, uint32 box, const uint64* reach) {
+	uint16		queue[BOARD_MAX_CELLS];
+	uint64		seen[BOARD_MAX_HEIGHT];
+	uint32		d;
+
+	memset(seen, 0, sizeof(uint64) * b->height);
+
+	for( d = KEY_UP; d <= KEY_LEFT; ++d ) {
+		uint32	start	= box + board_delta((KEY)d);
+		uint32	head	= 0;
+		uint32	tail	= 0;
+		bool	sealed	= true;
+		bool	goal	= false;
+
+		if( !board_walkable(b, start) || board_test(b->boxes, start) || board_test(reach, start) || board_test(seen, start) ) {
+			continue;
+		}
+
+		board_set(seen, start);
+		queue[tail++]	= (uint16)start;
+
+		while( head < tail && sealed ) {
+			uint32	pos	= queue[head++];
+			uint32	k;
+
+			goal	|= board_test(b->goals, pos);
+			for( k = KEY_UP; k <= KEY_LEFT; ++k ) {
+				uint32	n	= pos + board_delta((KEY)k);
+				if( !board_walkable(b, n) || board_test(seen, n) ) {
+					continue;
+				}
+				if( board_test(b->boxes, n) ) {
+					sealed	= (n == box) || (pattern_lookup(cache, b, n) & PATTERN_FROZEN);
+					if( !sealed ) {
+						break;
+					}
+					continue;
+				}
+				board_set(seen, n);
+				queue[tail++]	= (uint16)n;
+			}
+		}
+
+		if( sealed && goal ) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+DEADLOCK
+deadlock_check(deadlock_cache_t* cache, const board_t* b, uint32 box, const uint64* reach) {
+	uint64	own_reach[BOARD_MAX_HEIGHT];
+	uint32	pattern;
+
+	if( board_test(b->dead, box) ) {
+		return DEADLOCK_DEAD_SQUARE;
+	}
+
+	pattern	= pattern_lookup(cache, b, box);
+	if( pattern & PATTERN_DEADLOCK ) {
+		return DEADLOCK_FREEZE;
+	}
+
+	/* only a frozen box can close a corral for good */
+	if( !(pattern & PATTERN_FROZEN) ) {
+		return DEADLOCK_NONE;
+	}
+
+	if( NULL == reach ) {
+		board_reachable(b, b->player, own_reach);
+		reach	= own_reach;
+	}
+
+	return corral_deadlock(cache, b, box, reach) ? DEADLOCK_CORRAL : DEADLOCK_NONE;
+}
+
+const char*
+deadlock_string(DEADLOCK d) {
+	switch( d ) {
+	case DEADLOCK_NONE			: return "none";
+	case DEADLOCK_DEAD_SQUARE	: return "dead square";
+	case DEADLOCK_FREEZE		: return "freeze";
+	case DEADLOCK_CORRAL		: return "corral";
+	}
+	return "unknown";
+}
@@ -0,0 +1,252 @@
+/*
+** BoxWorld Copyright 2016(c) Wael El Oraiby. All Rights Reserved
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** Under Section 7 of GPL version 3, you are granted additional
+** permissions described in the GCC Runtime Library Exception, version
+** 3.1, as published by the Free Software Foundation.
+**
+** You should have received a copy of the GNU General Public License and
+** a copy of the GCC Runtime Library Exception along with this program;
+** see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+** <http://www.gnu.org/licenses/>.
+**
+*/
+#include "boxworld.h"
+#include <pthread.h>
+#include <unistd.h>
+
+/*
+ * finds the levels that repeat across collections, up to rotation, mirroring
+ * and where the player stands in its region. The canonical fingerprints are
+ * computed concurrently, then sorted: every level after the first of its
+ * fingerprint (in command line order) is a duplicate. The first ones can be
+ * written out as a merged collection, as they were, with their solutions.
+ * Levels that can't be canonicalized (fingerprint 0) are reported and kept
+ * out of the comparison, they count as unique.
+ */
+
+enum {
+	DEDUP_CHUNK	= 64,		/* levels claimed by a worker at a time */
+};
+
+typedef struct {
+	uint64		fingerprint;
+	uint32		file;
+	uint32		level;
+	uint32		order;		/* position over all the files, breaks fingerprint ties */
+	uint32		first;		/* order of the level it duplicates, itself when unique */
+} entry_t;
+
+typedef struct {
+	level_collection_t**	colls;
+	entry_t*				entries;
+	uint32					count;
+	volatile uint32			next;
+} dedup_t;
+
+static void*
+dedup_worker(void* arg) {
+	dedup_t*	d	= (dedup_t*)arg;
+
+	for( ;; ) {
+		uint32	first	= __sync_fetch_and_add(&(d->next), DEDUP_CHUNK);
+		uint32	i;
+
+		if( first >= d->count ) {
+			break;
+		}
+
+		for( i = first; i < MIN(first + DEDUP_CHUNK, d->count); ++i ) {
+			entry_t*	e	= &(d->entries[i]);
+			e->fingerprint	= level_canonical_fingerprint(&(d->colls[e->file]->levels[e->level]));
+		}
+	}
+
+	return NULL;
+}
+
+static int
+compare_entries(const void* a, const void* b) {
+	const entry_t*	ea	= (const entry_t*)a;
+	const entry_t*	eb	= (const entry_t*)b;
+
+	if( ea->fingerprint != eb->fingerprint ) {
+		return ea->fingerprint < eb->fingerprint ? -1 : 1;
+	}
+	return ea->order < eb->order ? -1 : (ea->order > eb->order);
+}
+
+static int
+compare_order(const void* a, const void* b) {
+	const entry_t*	ea	= (const entry_t*)a;
+	const entry_t*	eb	= (const entry_t*)b;
+	return ea->order < eb->order ? -1 : (ea->order > eb->order);
+}
+
+static void
+usage(const char* name) {
+	fprintf(stderr, "usage: %s [-j threads] [-o merged.sok] [-q] <levels.sok>...\n", name);
+	fprintf(stderr, "\t-j\tworker threads (default: one per core)\n");
+	fprintf(stderr, "\t-o\twrite the first copy of every level to merged.sok\n");
+	fprintf(stderr, "\t-q\tdon't list the duplicates\n");
+}
+
+int
+main(int argc, char** argv) {
+	dedup_t				d;
+	const char**		paths;
+	const char*			out_path	= NULL;
+	uint32				files		= 0;
+	uint32				threads		= (uint32)sysconf(_SC_NPROCESSORS_ONLN);
+	bool				quiet		= false;
+	pthread_t*			workers;
+	double				start, elapsed;
+	uint32				duplicates	= 0;
+	uint32				failed		= 0;
+	uint32				i, f, l;
+	int					a;
+
+	memset(&d, 0, sizeof(dedup_t));
+	paths	= (const char**)malloc(sizeof(const char*) * (size_t)argc);
+	assert( NULL != paths );
+
+	for( a = 1; a < argc; ++a ) {
+		if( 0 == strcmp(argv[a], "-j") && a + 1 < argc ) {
+			threads	= (uint32)atoi(argv[++a]);
+		} else if( 0 == strcmp(argv[a], "-o") && a + 1 < argc ) {
+			out_path	= argv[++a];
+		} else if( 0 == strcmp(argv[a], "-q") ) {
+			quiet	= true;
+		} else if( argv[a][0] == '-' && argv[a][1] != '\0' ) {
+			usage(argv[0]);
+			free(paths);
+			return EXIT_FAILURE;
+		} else {
+			paths[files++]	= argv[a];
+		}
+	}
+
+	if( 0 == files ) {
+		usage(argv[0]);
+		free(paths);
+		return EXIT_FAILURE;
+	}
+
+	threads	= MAX(threads, 1);
+	start	= boxworld_seconds();
+
+	d.colls	= (level_collection_t**)calloc(files, sizeof(level_collection_t*));
+	assert( NULL != d.colls );
+
+	for( f = 0; f < files; ++f ) {
+		d.colls[f]	= level_collection_load(paths[f]);
+		if( NULL == d.colls[f] ) {
+			fprintf(stderr, "unable to read %s:\n%s\n", paths[f], boxworld_error_string());
+			for( i = 0; i < f; ++i ) {
+				level_collection_release(d.colls[i]);
+			}
+			free(d.colls);
+			free(paths);
+			return EXIT_FAILURE;
+		}
+		d.count	+= d.colls[f]->count;
+	}
+
+	d.entries	= (entry_t*)malloc(sizeof(entry_t) * MAX(d.count, 1));
+	workers		= (pthread_t*)malloc(sizeof(pthread_t) * threads);
+	assert( NULL != d.entries && NULL != workers );
+
+	for( f = 0, i = 0; f < files; ++f ) {
+		for( l = 0; l < d.colls[f]->count; ++l, ++i ) {
+			d.entries[i].file	= f;
+			d.entries[i].level	= l;
+			d.entries[i].order	= i;
+		}
+	}
+
+	/* the calling thread is the first worker */
+	for( i = 1; i < threads; ++i ) {
+		if( 0 != pthread_create(&(workers[i]), NULL, dedup_worker, &d) ) {
+			break;
+		}
+	}
+	threads	= i;
+	dedup_worker(&d);
+	for( i = 1; i < threads; ++i ) {
+		pthread_join(workers[i], NULL);
+	}
+
+	/* copies end up next to each other, the first one leading */
+	qsort(d.entries, d.count, sizeof(entry_t), compare_entries);
+	for( i = 0; i < d.count; ++i ) {
+		uint64	fingerprint	= d.entries[i].fingerprint;
+		bool	dup			= i > 0 && 0 != fingerprint && fingerprint == d.entries[i - 1].fingerprint;
+		d.entries[i].first	= dup ? d.entries[i - 1].first : d.entries[i].order;
+		duplicates			+= dup;
+		failed				+= 0 == fingerprint;
+	}
+	qsort(d.entries, d.count, sizeof(entry_t), compare_order);
+
+	elapsed	= boxworld_seconds() - start;
+
+	for( i = 0; i < d.count; ++i ) {
+		const entry_t*	e	= &(d.entries[i]);
+
+		if( 0 == e->fingerprint ) {
+			fprintf(stderr, "%s:%u: unable to canonicalize\n", paths[e->file], e->level + 1);
+		}
+	}
+
+	if( !quiet ) {
+		for( i = 0; i < d.count; ++i ) {
+			const entry_t*	e	= &(d.entries[i]);
+			const entry_t*	o	= &(d.entries[e->first]);
+
+			if( e->first != e->order ) {
+				printf("%s:%u duplicates %s:%u\n", paths[e->file], e->level + 1, paths[o->file], o->level + 1);
+			}
+		}
+	}
+
+	if( out_path ) {
+		FILE*	out	= fopen(out_path, "w");
+
+		if( NULL == out ) {
+			fprintf(stderr, "unable to write %s\n", out_path);
+		} else {
+			for( i = 0; i < d.count; ++i ) {
+				const entry_t*				e		= &(d.entries[i]);
+				const level_collection_t*	coll	= d.colls[e->file];
+
+				if( e->first != e->order ) {
+					continue;
+				}
+
+				fprintf(out, "; %s %u\n\n", paths[e->file], e->level + 1);
+				level_write(out, &(coll->levels[e->level]));
+				if( coll->solutions[e->level] ) {
+					fprintf(out, "Solution: %s\n", coll->solutions[e->level]);
+				}
+				fputc('\n', out);
+			}
+			fclose(out);
+		}
+	}
+
+	fprintf(stderr, "%u files, %u levels, %u unique, %u duplicates, %u not canonicalized, %u threads, %.3f s\n",
+			files, d.count, d.count - duplicates, duplicates, failed, threads, elapsed);
+
+	for( f = 0; f < files; ++f ) {
+		level_collection_release(d.colls[f]);
+	}
+	free(workers);
+	free(d.entries);
+	free(d.colls);
+	free(paths);
+	return EXIT_SUCCESS;
+}
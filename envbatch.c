@@ -0,0 +1,190 @@
+/*
+** BoxWorld Copyright 2016(c) Wael El Oraiby. All Rights Reserved
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** Under Section 7 of GPL version 3, you are granted additional
+** permissions described in the GCC Runtime Library Exception, version
+** 3.1, as published by the Free Software Foundation.
+**
+** You should have received a copy of the GNU General Public License and
+** a copy of the GCC Runtime Library Exception along with this program;
+** see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+** <http://www.gnu.org/licenses/>.
+**
+*/
+#include "boxworld.h"
+
+/*
+ * many sessions of one level stepped together. The static planes are shared,
+ * every other field is an array indexed by environment. Planes are flat
+ * bitmaps of 32 bit words, square pos is bit (pos & 31) of word (pos >> 5),
+ * so every lane of the step is 32 bits wide. The step has the same rules as
+ * board_step, split in two passes: a branch free pass that only reads the
+ * bitmaps and writes each environment's own player, goal count and result,
+ * then a scalar pass moving the pushed boxes. The first pass vectorizes when
+ * the target has gathers and per lane shifts (-O3 -mavx2), plain SSE2 has
+ * neither and runs it one environment at a time.
+ */
+
+enum {
+	WORD_SHIFT	= 5,
+	WORD_BITS	= 1 << WORD_SHIFT,
+};
+
+/* position offset per key, 0 for the keys that don't move */
+static const uint32	key_delta[KEY_EXIT + 1]	= {
+	(uint32)-BOARD_STRIDE, 1, BOARD_STRIDE, (uint32)-1, 0, 0, 0
+};
+
+/* a board plane as 32 bit words */
+static void
+plane_to_words(const uint64* plane, uint32 height, uint32* words) {
+	uint32	y;
+
+	for( y = 0; y < height; ++y ) {
+		words[y * 2]		= (uint32)plane[y];
+		words[y * 2 + 1]	= (uint32)(plane[y] >> WORD_BITS);
+	}
+}
+
+bool
+env_batch_init(env_batch_t* eb, const level_t* lvl, uint32 count) {
+	board_t		b;
+	uint32		words;
+	uint32		e;
+
+	memset(eb, 0, sizeof(env_batch_t));
+
+	if( !board_from_level(&b, lvl) ) {
+		return false;
+	}
+
+	/* the slab is indexed with 32 bit lanes */
+	words	= b.height * (BOARD_STRIDE / WORD_BITS);
+	if( count > UINT32_MAX / words - 3 ) {
+		board_release(&b);
+		boxworld_error(UNSUPPORTED, "env_batch_init: too many environments");
+		return false;
+	}
+
+	eb->floor	= (uint32*)malloc(sizeof(uint32) * words * ((size_t)count + 3));
+	eb->player	= (uint32*)malloc(sizeof(uint32) * MAX(count, 1) * 2);
+	if( NULL == eb->floor || NULL == eb->player ) {
+		free(eb->floor);
+		free(eb->player);
+		board_release(&b);
+		boxworld_error(NOT_ENOUGH_MEMORY, "env_batch_init: not enough memory");
+		return false;
+	}
+
+	/* the shared bitmaps come first, the box slab follows */
+	eb->count			= count;
+	eb->words			= words;
+	eb->initial			= b;
+	eb->goals			= eb->floor + words;
+	eb->dead			= eb->floor + words * 2;
+	eb->boxes			= eb->floor + words * 3;
+	eb->boxes_on_goal	= eb->player + MAX(count, 1);
+	plane_to_words(b.floor, b.height, eb->floor);
+	plane_to_words(b.goals, b.height, eb->goals);
+	plane_to_words(b.dead, b.height, eb->dead);
+
+	for( e = 0; e < count; ++e ) {
+		env_batch_reset(eb, e);
+	}
+	return true;
+}
+
+void
+env_batch_release(env_batch_t* eb) {
+	board_release(&(eb->initial));
+	free(eb->floor);
+	free(eb->player);
+	memset(eb, 0, sizeof(env_batch_t));
+}
+
+void
+env_batch_reset(env_batch_t* eb, uint32 env) {
+	plane_to_words(eb->initial.boxes, eb->initial.height, eb->boxes + (size_t)env * eb->words);
+	eb->player[env]			= eb->initial.player;
+	eb->boxes_on_goal[env]	= eb->initial.boxes_on_goal;
+}
+
+/*
+ * decides every move: loads only, every store goes to the environment's own
+ * slot. The restrict parameters let the loop vectorize, the compiler doesn't
+ * trust restrict on locals
+ */
+static void
+decide_moves(const uint32* restrict floor, const uint32* restrict goals, const uint32* restrict dead,
+			 const uint32* restrict boxes, const KEY* restrict keys, uint32* restrict player,
+			 uint32* restrict on_goal, uint8* restrict res, uint32 count, uint32 words,
+			 uint32 limit, uint32 total) {
+	uint32	base	= 0;
+	uint32	e;
+
+	for( e = 0; e < count; ++e, base += words ) {
+		uint32	delta	= key_delta[keys[e]];
+		uint32	p		= player[e];
+		uint32	to		= p + delta;
+		uint32	box_to	= to + delta;
+
+		/* squares off the board are read from word 0 and masked out */
+		uint32	in1		= to < limit;
+		uint32	in2		= box_to < limit;
+		uint32	w1		= (to >> WORD_SHIFT) & -in1;
+		uint32	w2		= (box_to >> WORD_SHIFT) & -in2;
+		uint32	s1		= to & (WORD_BITS - 1);
+		uint32	s2		= box_to & (WORD_BITS - 1);
+
+		uint32	free1	= in1 & (floor[w1] >> s1) & (delta != 0);
+		uint32	box1	= (boxes[base + w1] >> s1) & 1;
+		uint32	free2	= in2 & (floor[w2] >> s2) & ~(boxes[base + w2] >> s2) & 1;
+		uint32	moved	= free1 & (~box1 | free2) & 1;
+		uint32	push	= moved & box1;
+		uint32	goals_now	= on_goal[e] + (((goals[w2] >> s2) & push) - ((goals[w1] >> s1) & push));
+		uint32	solved	= push & (goals_now == total);
+
+		player[e]	= p + (delta & -moved);
+		on_goal[e]	= goals_now;
+		res[e]		= (uint8)((moved * MOVE_WALK) | (push * MOVE_PUSH) | (solved * MOVE_SOLVED) |
+							  ((push & ~solved & (dead[w2] >> s2) & 1) * MOVE_DEADLOCK));
+	}
+}
+
+void
+env_batch_step(env_batch_t* eb, const KEY* keys, uint8* results) {
+	uint32	e;
+
+	decide_moves(eb->floor, eb->goals, eb->dead, eb->boxes, keys, eb->player, eb->boxes_on_goal, results,
+				 eb->count, eb->words, eb->initial.height << BOARD_SHIFT, eb->initial.box_count);
+
+	/* then move the pushed boxes, the player stands where the box was */
+	for( e = 0; e < eb->count; ++e ) {
+		if( results[e] & MOVE_PUSH ) {
+			uint32	from	= eb->player[e];
+			uint32	to		= from + key_delta[keys[e]];
+			uint32*	env		= eb->boxes + (size_t)e * eb->words;
+			env[from >> WORD_SHIFT]	&= ~(1u << (from & (WORD_BITS - 1)));
+			env[to >> WORD_SHIFT]	|= 1u << (to & (WORD_BITS - 1));
+		}
+	}
+}
+
+/* b must be allocated with the level height */
+void
+env_batch_board(const env_batch_t* eb, uint32 env, board_t* b) {
+	const uint32*	words	= eb->boxes + (size_t)env * eb->words;
+	uint32			y;
+
+	board_copy(b, &(eb->initial));
+	for( y = 0; y < eb->initial.height; ++y ) {
+		b->boxes[y]	= (uint64)words[y * 2] | ((uint64)words[y * 2 + 1] << WORD_BITS);
+	}
+	b->player			= eb->player[env];
+	b->boxes_on_goal	= eb->boxes_on_goal[env];
+}
@@ -0,0 +1,193 @@
+/*
+** BoxWorld Copyright 2016(c) Wael El Oraiby. All Rights Reserved
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** Under Section 7 of GPL version 3, you are granted additional
+** permissions described in the GCC Runtime Library Exception, version
+** 3.1, as published by the Free Software Foundation.
+**
+** You should have received a copy of the GNU General Public License and
+** a copy of the GCC Runtime Library Exception along with this program;
+** see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+** <http://www.gnu.org/licenses/>.
+**
+*/
+#include "boxworld.h"
+
+/*
+ * level candidates: a walled room with random wall squares, cut down to one
+ * connected floor, gets a box on every goal. The player then walks it in
+ * reverse, pulling boxes off the goals (board_pull), so whatever position it
+ * ends in can be pushed back: every candidate is solvable. Walls that touch
+ * no floor are dropped so the level reads like a hand made one.
+ */
+
+static INLINE uint32
+next_random(uint64* seed) {
+	uint64	x	= *seed;
+
+	x	^= x << 13;
+	x	^= x >> 7;
+	x	^= x << 17;
+	*seed	= x;
+	return (uint32)(x >> 32);
+}
+
+generator_params_t
+generator_default_params() {
+	generator_params_t	p;
+	p.width			= 10;
+	p.height		= 9;
+	p.boxes			= 3;
+	p.wall_percent	= 20;
+	p.pulls			= 300;
+	return p;
+}
+
+/* random floor square of the marked region, count is the region size */
+static uint32
+random_square(const uint8* region, uint32 size, uint32 count, uint64* seed) {
+	uint32	n	= next_random(seed) % count;
+	uint32	i;
+
+	for( i = 0; i < size; ++i ) {
+		if( region[i] && 0 == n-- ) {
+			break;
+		}
+	}
+	return i;
+}
+
+bool
+level_generate(const generator_params_t* p, uint64* seed, level_t* out) {
+	uint32		w		= p->width;
+	uint32		h		= p->height;
+	uint32		size	= w * h;
+	cell_t*		cells;
+	uint8*		region;
+	uint32*		stack;
+	uint32		top		= 0;
+	uint32		floor	= 0;
+	uint32		i, x, y;
+	level_t		room;
+	board_t		b;
+	bool		ok		= false;
+
+	if( w < 3 || h < 3 || w > BOARD_MAX_WIDTH || h > BOARD_MAX_HEIGHT || 0 == p->boxes ) {
+		boxworld_error(UNSUPPORTED, "level_generate: unsupported room size");
+		return false;
+	}
+
+	cells	= (cell_t*)malloc((sizeof(cell_t) + 1 + sizeof(uint32)) * (size_t)size);
+	if( NULL == cells ) {
+		boxworld_error(NOT_ENOUGH_MEMORY, "level_generate: not enough memory");
+		return false;
+	}
+	stack	= (uint32*)(void*)(cells + size);
+	region	= (uint8*)(stack + size);
+
+	if( 0 == *seed ) {
+		*seed	= 0x9E3779B97F4A7C15ull;		/* xorshift never leaves 0 */
+	}
+
+	for( y = 0; y < h; ++y ) {
+		for( x = 0; x < w; ++x ) {
+			bool	border	= 0 == x || 0 == y || w - 1 == x || h - 1 == y;
+			cells[y * w + x].bg		= border || next_random(seed) % 100 < p->wall_percent ? BG_WALL : BG_GROUND;
+			cells[y * w + x].actor	= ACT_NONE;
+		}
+	}
+
+	/* keep the floor connected to a random square */
+	memset(region, 0, size);
+	for( i = 0; i < size; ++i ) {
+		floor	+= BG_GROUND == cells[i].bg;
+	}
+	if( floor < p->boxes + 2 ) {
+		goto done;
+	}
+
+	for( i = 0; i < size; ++i ) {
+		region[i]	= BG_GROUND == cells[i].bg;
+	}
+	i	= random_square(region, size, floor, seed);
+	memset(region, 0, size);
+	region[i]		= 1;
+	stack[top++]	= i;
+	floor			= 1;
+
+	while( top ) {
+		uint32	c	= stack[--top];
+		uint32	n[4]	= { c - 1, c + 1, c - w, c + w };		/* the border is all walls */
+		uint32	k;
+
+		for( k = 0; k < 4; ++k ) {
+			if( !region[n[k]] && BG_GROUND == cells[n[k]].bg ) {
+				region[n[k]]	= 1;
+				stack[top++]	= n[k];
+				++floor;
+			}
+		}
+	}
+
+	if( floor < p->boxes + 2 ) {
+		goto done;
+	}
+
+	for( i = 0; i < size; ++i ) {
+		if( !region[i] ) {
+			cells[i].bg	= BG_WALL;
+		}
+	}
+
+	/* boxes on the goals, the player anywhere else */
+	for( i = 0; i < p->boxes; ++i ) {
+		uint32	g	= random_square(region, size, floor--, seed);
+		cells[g].bg		= BG_PLACE;
+		cells[g].actor	= ACT_BOX;
+		region[g]		= 0;
+	}
+	cells[random_square(region, size, floor, seed)].actor	= ACT_PLAYER;
+
+	room.width	= w;
+	room.height	= h;
+	room.cells	= cells;
+	if( !board_from_level(&b, &room) ) {
+		goto done;
+	}
+
+	/* mostly pulls, a plain step now and then lets the player let go of a box */
+	for( i = 0; i < p->pulls; ++i ) {
+		uint32	r	= next_random(seed);
+		board_pull(&b, (KEY)(r & 3), 0 != ((r >> 2) & 7));
+	}
+
+	ok	= b.boxes_on_goal < b.box_count && board_to_level(&b, out);
+	board_release(&b);
+
+	/* walls with no floor around them go */
+	for( y = 0; ok && y < h; ++y ) {
+		for( x = 0; x < w; ++x ) {
+			bool	inner	= false;
+			uint32	dx, dy;
+
+			for( dy = y ? y - 1 : 0; dy <= MIN(y + 1, h - 1); ++dy ) {
+				for( dx = x ? x - 1 : 0; dx <= MIN(x + 1, w - 1); ++dx ) {
+					inner	= inner || (BG_GROUND == cells[dy * w + dx].bg || BG_PLACE == cells[dy * w + dx].bg);
+				}
+			}
+
+			if( !inner ) {
+				out->cells[y * w + x].bg	= BG_EMPTY;
+			}
+		}
+	}
+
+done:
+	free(cells);
+	return ok;
+}
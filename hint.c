@@ -0,0 +1,262 @@
+/*
+** BoxWorld Copyright 2016(c) Wael El Oraiby. All Rights Reserved
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** Under Section 7 of GPL version 3, you are granted additional
+** permissions described in the GCC Runtime Library Exception, version
+** 3.1, as published by the Free Software Foundation.
+**
+** You should have received a copy of the GNU General Public License and
+** a copy of the GCC Runtime Library Exception along with this program;
+** see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+** <http://www.gnu.org/licenses/>.
+**
+*/
+#include "boxworld.h"
+#include <pthread.h>
+#include <semaphore.h>
+
+/*
+ * background hints. The game thread and the worker exchange data through two
+ * single slot mailboxes, each guarded by a sequence counter (odd while the
+ * slot is being written): the request slot holds the position as a packed
+ * snapshot, the hint slot the last answer. The game side never waits: it
+ * overwrites the request, raises the cancel flag the solver polls and posts
+ * the semaphore the worker sleeps on, and it reads the hint slot once,
+ * keeping its previous hint when it catches the worker mid write.
+ */
+
+struct hint_worker_s {
+	pthread_t			thread;
+	sem_t				wake;
+	snapshot_codec_t	codec;
+	solver_params_t		params;
+	board_t				board;			/* worker copy of the position */
+	key_array_t			keys;
+
+	/* request slot, written by the game thread */
+	volatile uint32		request_seq;
+	volatile uint32		generation;
+	double				requested;		/* boxworld_seconds of the request */
+	uint64*				request;		/* codec.words */
+
+	/* hint slot, written by the worker */
+	volatile uint32		hint_seq;
+	hint_t				hint;
+
+	volatile uint32		cancel;			/* polled by the solver */
+	volatile uint32		quit;
+};
+
+const char*
+hint_status_string(HINT_STATUS status) {
+	switch( status ) {
+	case HINT_PUSH		: return "push";
+	case HINT_SOLVED	: return "solved";
+	case HINT_DEADLOCK	: return "deadlock";
+	case HINT_UNKNOWN	: return "unknown";
+	}
+	return "unknown";
+}
+
+/*
+ * copies the request into the worker board, false when the slot changed under
+ * it. decoded is false when the slot was stable but the snapshot is corrupted
+ */
+static bool
+read_request(hint_worker_t* w, uint32* generation, double* requested, bool* decoded) {
+	uint32	seq	= w->request_seq;
+
+	__sync_synchronize();
+	if( seq & 1 ) {
+		return false;
+	}
+
+	*generation	= w->generation;
+	*requested	= w->requested;
+	*decoded	= snapshot_decode(&(w->codec), w->request, &(w->board));
+
+	__sync_synchronize();
+	return seq == w->request_seq;
+}
+
+static void
+publish(hint_worker_t* w, const hint_t* hint) {
+	++(w->hint_seq);
+	__sync_synchronize();
+	w->hint	= *hint;
+	__sync_synchronize();
+	++(w->hint_seq);
+}
+
+/* the first push of the solution from the worker board */
+static void
+first_push(hint_worker_t* w, hint_t* hint) {
+	uint32	k;
+
+	hint->status	= HINT_SOLVED;
+	for( k = 0; k < w->keys.count; ++k ) {
+		KEY		key		= w->keys.array[k];
+		uint32	box		= w->board.player + board_delta(key);
+
+		if( board_step(&(w->board), key) & MOVE_PUSH ) {
+			hint->status	= HINT_PUSH;
+			hint->box		= box;
+			hint->dir		= key;
+			hint->walk		= k;
+			return;
+		}
+	}
+}
+
+static void*
+hint_worker(void* arg) {
+	hint_worker_t*	w	= (hint_worker_t*)arg;
+	uint32			done	= 0;		/* last generation answered */
+
+	for( ;; ) {
+		solver_stats_t	st;
+		hint_t			hint;
+		uint32			generation;
+		double			requested;
+		bool			decoded;
+
+		while( !w->quit && done == w->generation ) {
+			sem_wait(&(w->wake));
+		}
+		if( w->quit ) {
+			break;
+		}
+
+		/* a cancel raised for an older request must not stop this one */
+		w->cancel	= 0;
+		__sync_synchronize();
+		if( !read_request(w, &generation, &requested, &decoded) ) {
+			continue;
+		}
+		if( !decoded ) {
+			done	= generation;		/* dropped, the old hint stays stale */
+			continue;
+		}
+
+		solver_solve_board(&(w->board), &(w->params), &(w->keys), &st);
+		if( SOLVER_CANCELLED == st.result || generation != w->generation ) {
+			continue;		/* a newer position is waiting */
+		}
+
+		memset(&hint, 0, sizeof(hint_t));
+		hint.generation	= generation;
+		hint.pushes		= st.pushes;
+		switch( st.result ) {
+		case SOLVER_SOLVED		: first_push(w, &hint); break;
+		case SOLVER_UNSOLVABLE	: hint.status = HINT_DEADLOCK; break;
+		default					: hint.status = HINT_UNKNOWN; break;
+		}
+		hint.latency	= boxworld_seconds() - requested;
+
+		publish(w, &hint);
+		done	= generation;
+	}
+
+	return NULL;
+}
+
+hint_worker_t*
+hint_worker_create(const level_t* lvl, const solver_params_t* params) {
+	hint_worker_t*	w	= (hint_worker_t*)calloc(1, sizeof(hint_worker_t));
+
+	if( NULL == w ) {
+		return (hint_worker_t*)boxworld_error(NOT_ENOUGH_MEMORY, "hint_worker_create: not enough memory");
+	}
+
+	if( !board_from_level(&(w->board), lvl) ) {
+		free(w);
+		return NULL;
+	}
+
+	if( !snapshot_codec_init(&(w->codec), &(w->board), false) ) {
+		board_release(&(w->board));
+		free(w);
+		return NULL;
+	}
+
+	w->request	= (uint64*)calloc(w->codec.words, sizeof(uint64));
+	if( NULL == w->request || 0 != sem_init(&(w->wake), 0, 0) ) {
+		free(w->request);
+		snapshot_codec_release(&(w->codec));
+		board_release(&(w->board));
+		free(w);
+		return (hint_worker_t*)boxworld_error(NOT_ENOUGH_MEMORY, "hint_worker_create: not enough memory");
+	}
+
+	w->params			= *params;
+	w->params.cancel	= &(w->cancel);
+	w->keys				= key_array_new();
+
+	if( 0 != pthread_create(&(w->thread), NULL, hint_worker, w) ) {
+		sem_destroy(&(w->wake));
+		free(w->request);
+		snapshot_codec_release(&(w->codec));
+		board_release(&(w->board));
+		free(w);
+		return (hint_worker_t*)boxworld_error(UNSUPPORTED, "hint_worker_create: unable to start the worker");
+	}
+
+	return w;
+}
+
+void
+hint_worker_release(hint_worker_t* w) {
+	w->quit		= 1;
+	w->cancel	= 1;
+	sem_post(&(w->wake));
+	pthread_join(w->thread, NULL);
+
+	sem_destroy(&(w->wake));
+	key_array_release(&(w->keys));
+	free(w->request);
+	snapshot_codec_release(&(w->codec));
+	board_release(&(w->board));
+	free(w);
+}
+
+uint32
+hint_request(hint_worker_t* w, const board_t* b) {
+	uint32	generation	= w->generation + 1;
+
+	++(w->request_seq);
+	__sync_synchronize();
+	snapshot_encode(&(w->codec), b, w->request);
+	w->requested	= boxworld_seconds();
+	w->generation	= generation;
+	__sync_synchronize();
+	++(w->request_seq);
+
+	w->cancel	= 1;
+	sem_post(&(w->wake));
+	return generation;
+}
+
+bool
+hint_latest(const hint_worker_t* w, hint_t* hint) {
+	uint32	seq	= w->hint_seq;
+	hint_t	h;
+
+	__sync_synchronize();
+	if( seq & 1 ) {
+		return false;
+	}
+
+	h	= w->hint;
+	__sync_synchronize();
+	if( seq != w->hint_seq ) {
+		return false;
+	}
+
+	*hint	= h;
+	return h.generation == w->generation && h.generation != 0;
+}
@@ -0,0 +1,648 @@
+/*
+** BoxWorld Copyright 2016(c) Wael El Oraiby. All Rights Reserved
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** Under Section 7 of GPL version 3, you are granted additional
+** permissions described in the GCC Runtime Library Exception, version
+** 3.1, as published by the Free Software Foundation.
+**
+** You should have received a copy of the GNU General Public License and
+** a copy of the GCC Runtime Library Exception along with this program;
+** see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+** <http://www.gnu.org/licenses/>.
+**
+*/
+#include "boxworld.h"
+
+bool
+board_allocate(board_t* b, uint32 width, uint32 height) {
+	uint64*		planes	= NULL;
+
+	memset(b, 0, sizeof(board_t));
+
+	if( width > BOARD_MAX_WIDTH || height > BOARD_MAX_HEIGHT ) {
+		boxworld_error(UNSUPPORTED, "board_allocate: level is too big");
+		return false;
+	}
+
+	/* walls, floor, goals, dead, boxes */
+	planes	= (uint64*)malloc(sizeof(uint64) * height * BOARD_PLANES);
+	if( NULL == planes ) {
+		boxworld_error(NOT_ENOUGH_MEMORY, "board_allocate: not enough memory");
+		return false;
+	}
+
+	memset(planes, 0, sizeof(uint64) * height * BOARD_PLANES);
+
+	b->width	= width;
+	b->height	= height;
+	b->walls	= planes;
+	b->floor	= planes + height;
+	b->goals	= planes + height * 2;
+	b->dead		= planes + height * 3;
+	b->boxes	= planes + height * 4;
+	return true;
+}
+
+void
+board_release(board_t* b) {
+	free(b->walls);
+	memset(b, 0, sizeof(board_t));
+}
+
+/* dst must be allocated with the same height as src */
+void
+board_copy(board_t* dst, const board_t* src) {
+	uint64*		planes	= dst->walls;
+
+	assert( dst->height == src->height );
+
+	memcpy(planes, src->walls, sizeof(uint64) * src->height * BOARD_PLANES);
+	*dst		= *src;
+	dst->walls	= planes;
+	dst->floor	= planes + src->height;
+	dst->goals	= planes + src->height * 2;
+	dst->dead	= planes + src->height * 3;
+	dst->boxes	= planes + src->height * 4;
+}
+
+bool
+board_from_level(board_t* b, const level_t* lvl) {
+	uint32		x, y;
+	uint32		players	= 0;
+	uint32		goals	= 0;
+
+	if( !board_allocate(b, lvl->width, lvl->height) ) {
+		return false;
+	}
+
+	for( y = 0; y < lvl->height; ++y ) {
+		for( x = 0; x < lvl->width; ++x ) {
+			cell_t	c	= lvl->cells[y * lvl->width + x];
+			uint32	pos	= board_pos(x, y);
+			bool	fl	= false;
+
+			switch( c.bg ) {
+			case BG_EMPTY	: break;
+			case BG_WALL	: board_set(b->walls, pos); break;
+			case BG_PLACE	: board_set(b->goals, pos); ++goals; /* fall through */
+			case BG_GROUND	: board_set(b->floor, pos); fl = true; break;
+			}
+
+			if( c.actor != ACT_NONE && !fl ) {
+				board_release(b);
+				boxworld_error(INVALID_FORMAT, "board_from_level: actor outside of the floor");
+				return false;
+			}
+
+			switch( c.actor ) {
+			case ACT_NONE	: break;
+			case ACT_PLAYER	: b->player = pos; ++players; break;
+			case ACT_BOX	:
+				board_set(b->boxes, pos);
+				++(b->box_count);
+				if( c.bg == BG_PLACE ) {
+					++(b->boxes_on_goal);
+				}
+				break;
+			}
+		}
+	}
+
+	if( players != 1 ) {
+		board_release(b);
+		boxworld_error(INVALID_FORMAT, "board_from_level: level must have exactly one player");
+		return false;
+	}
+
+	if( b->box_count != goals ) {
+		board_release(b);
+		boxworld_error(INVALID_FORMAT, "board_from_level: box and goal counts differ");
+		return false;
+	}
+
+	board_dead_squares(b, b->dead);
+	return true;
+}
+
+/* if lvl->cells is NULL it is allocated, otherwise it must hold width * height cells */
+bool
+board_to_level(const board_t* b, level_t* lvl) {
+	uint32		x, y;
+
+	if( NULL == lvl->cells ) {
+		lvl->cells	= (cell_t*)malloc(sizeof(cell_t) * b->width * b->height);
+		if( NULL == lvl->cells ) {
+			boxworld_error(NOT_ENOUGH_MEMORY, "board_to_level: not enough memory");
+			return false;
+		}
+	}
+
+	lvl->width	= b->width;
+	lvl->height	= b->height;
+
+	for( y = 0; y < b->height; ++y ) {
+		for( x = 0; x < b->width; ++x ) {
+			uint32	pos	= board_pos(x, y);
+			cell_t*	c	= &(lvl->cells[y * b->width + x]);
+
+			if( board_test(b->walls, pos) ) {
+				c->bg	= BG_WALL;
+			} else if( board_test(b->goals, pos) ) {
+				c->bg	= BG_PLACE;
+			} else if( board_test(b->floor, pos) ) {
+				c->bg	= BG_GROUND;
+			} else {
+				c->bg	= BG_EMPTY;
+			}
+
+			if( pos == b->player ) {
+				c->actor	= ACT_PLAYER;
+			} else if( board_test(b->boxes, pos) ) {
+				c->actor	= ACT_BOX;
+			} else {
+				c->actor	= ACT_NONE;
+			}
+		}
+	}
+
+	return true;
+}
+
+uint32
+board_step(board_t* b, KEY dir) {
+	uint32	delta	= board_delta(dir);
+	uint32	to		= b->player + delta;
+	uint32	box_to;
+
+	if( !board_walkable(b, to) ) {
+		return MOVE_NONE;
+	}
+
+	if( !board_test(b->boxes, to) ) {
+		b->player	= to;
+		return MOVE_WALK;
+	}
+
+	box_to	= to + delta;
+	if( !board_walkable(b, box_to) || board_test(b->boxes, box_to) ) {
+		return MOVE_NONE;
+	}
+
+	board_clear(b->boxes, to);
+	board_set(b->boxes, box_to);
+	b->boxes_on_goal	+= (uint32)board_test(b->goals, box_to) - (uint32)board_test(b->goals, to);
+	b->player			= to;
+
+	if( board_solved(b) ) {
+		return MOVE_WALK | MOVE_PUSH | MOVE_SOLVED;
+	}
+	return board_test(b->dead, box_to) ? MOVE_WALK | MOVE_PUSH | MOVE_DEADLOCK : MOVE_WALK | MOVE_PUSH;
+}
+
+/* takes back a board_step in direction dir, pushed tells if it moved a box */
+uint32
+board_unstep(board_t* b, KEY dir, bool pushed) {
+	uint32	delta	= board_delta(dir);
+	uint32	box		= b->player + delta;
+
+	if( pushed ) {
+		board_clear(b->boxes, box);
+		board_set(b->boxes, b->player);
+		b->boxes_on_goal	+= (uint32)board_test(b->goals, b->player) - (uint32)board_test(b->goals, box);
+	}
+
+	b->player	-= delta;
+	return pushed ? MOVE_WALK | MOVE_PUSH : MOVE_WALK;
+}
+
+/*
+ * spreads the seed bits of a row along the runs of open bits, both ways,
+ * with a Kogge-Stone fill: six shift-and-mask steps per direction
+ */
+static INLINE uint64
+fill_row(uint64 seed, uint64 open) {
+	uint64	l	= seed;
+	uint64	r	= seed;
+	uint64	pl	= open;
+	uint64	pr	= open;
+	uint32	s;
+
+	for( s = 1; s < BOARD_STRIDE; s <<= 1 ) {
+		l	|= pl & (l << s);
+		r	|= pr & (r >> s);
+		pl	&= pl << s;
+		pr	&= pr >> s;
+	}
+	return l | r;
+}
+
+/*
+ * squares the player can walk to from 'from' without pushing, written to the
+ * reach plane (height words). Returns the smallest reachable position, which
+ * identifies the player region.
+ *
+ * The reach plane is grown a whole row at a time: every row is filled along
+ * its free runs, then seeded from the rows above and below, sweeping down and
+ * up until nothing changes. Mazes converge in a few sweeps.
+ */
+uint32
+board_reachable(const board_t* b, uint32 from, uint64* reach) {
+	uint64		fc[BOARD_MAX_HEIGHT];
+	uint32		fy		= board_y(from);
+	bool		changed	= true;
+	uint32		y;
+
+	for( y = 0; y < b->height; ++y ) {
+		fc[y]		= b->floor[y] & ~b->boxes[y];
+		reach[y]	= 0;
+	}
+
+	/* 'from' itself counts as free, whatever is on it */
+	fc[fy]		|= (uint64)1 << board_x(from);
+	reach[fy]	= fill_row((uint64)1 << board_x(from), fc[fy]);
+
+	while( changed ) {
+		changed	= false;
+
+		for( y = 1; y < b->height; ++y ) {
+			uint64	seed	= reach[y - 1] & fc[y] & ~reach[y];
+			if( seed ) {
+				reach[y]	= fill_row(reach[y] | seed, fc[y]);
+				changed		= true;
+			}
+		}
+
+		for( y = b->height - 1; y-- > 0; ) {
+			uint64	seed	= reach[y + 1] & fc[y] & ~reach[y];
+			if( seed ) {
+				reach[y]	= fill_row(reach[y] | seed, fc[y]);
+				changed		= true;
+			}
+		}
+	}
+
+	for( y = 0; 0 == reach[y]; ++y ) {
+	}
+	return board_pos((uint32)__builtin_ctzll(reach[y]), y);
+}
+
+uint64
+board_boxes_hash(const board_t* b) {
+	uint64	h	= 0;
+	uint32	y;
+
+	for( y = 0; y < b->height; ++y ) {
+		uint64	row	= b->boxes[y];
+		while( row ) {
+			uint32	x	= (uint32)__builtin_ctzll(row);
+			h	^= zobrist_key(ZOBRIST_BOX, board_pos(x, y));
+			row	&= row - 1;
+		}
+	}
+
+	return h;
+}
+
+/*
+ * floor cells from which no sequence of pushes brings a box to a goal, even
+ * with no other box around. The live cells are found by pulling boxes away
+ * from the goals, everything else on the floor is dead. dead holds height
+ * words.
+ */
+void
+board_dead_squares(const board_t* b, uint64* dead) {
+	uint16		queue[BOARD_MAX_CELLS];
+	uint64		live[BOARD_MAX_HEIGHT];
+	uint32		head	= 0;
+	uint32		tail	= 0;
+	uint32		y, d;
+
+	for( y = 0; y < b->height; ++y ) {
+		uint64	row	= b->goals[y];
+		live[y]	= row;
+		while( row ) {
+			queue[tail++]	= (uint16)board_pos((uint32)__builtin_ctzll(row), y);
+			row	&= row - 1;
+		}
+	}
+
+	while( head < tail ) {
+		uint32	pos	= queue[head++];
+		for( d = KEY_UP; d <= KEY_LEFT; ++d ) {
+			uint32	delta	= board_delta((KEY)d);
+			uint32	from	= pos - delta;
+			if( board_walkable(b, from) && board_walkable(b, from - delta) && !board_test(live, from) ) {
+				board_set(live, from);
+				queue[tail++]	= (uint16)from;
+			}
+		}
+	}
+
+	for( y = 0; y < b->height; ++y ) {
+		dead[y]	= b->floor[y] & ~live[y];
+	}
+}
+
+/*
+ * minimum number of pushes to bring a box from each square to the nearest
+ * goal, ignoring the other boxes: boxes are pulled away from the goals.
+ * dist holds BOARD_MAX_CELLS entries, BOARD_DIST_INF marks squares that
+ * can't reach any goal.
+ */
+void
+board_push_distances(const board_t* b, uint16* dist) {
+	uint16		queue[BOARD_MAX_CELLS];
+	uint32		head	= 0;
+	uint32		tail	= 0;
+	uint32		y, d;
+
+	for( y = 0; y < BOARD_MAX_CELLS; ++y ) {
+		dist[y]	= BOARD_DIST_INF;
+	}
+
+	for( y = 0; y < b->height; ++y ) {
+		uint64	row	= b->goals[y];
+		while( row ) {
+			uint32	pos	= board_pos((uint32)__builtin_ctzll(row), y);
+			dist[pos]		= 0;
+			queue[tail++]	= (uint16)pos;
+			row	&= row - 1;
+		}
+	}
+
+	/* a box at 'pos' came from 'from', pushed by a player standing at 'from - delta' */
+	while( head < tail ) {
+		uint32	pos	= queue[head++];
+		for( d = KEY_UP; d <= KEY_LEFT; ++d ) {
+			uint32	delta	= board_delta((KEY)d);
+			uint32	from	= pos - delta;
+			if( board_walkable(b, from) && board_walkable(b, from - delta) && dist[from] == BOARD_DIST_INF ) {
+				dist[from]		= (uint16)(dist[pos] + 1);
+				queue[tail++]	= (uint16)from;
+			}
+		}
+	}
+}
+
+/* walk the player to 'to' along a shortest path without pushing, appending the keys */
+bool
+board_walk_to(board_t* b, uint32 to, key_array_t* keys) {
+	uint16		queue[BOARD_MAX_CELLS];
+	uint8		came[BOARD_MAX_CELLS];
+	KEY			path[BOARD_MAX_CELLS];
+	uint64		seen[BOARD_MAX_HEIGHT];
+	uint32		head	= 0;
+	uint32		tail	= 0;
+	uint32		len		= 0;
+	uint32		pos, d;
+
+	if( !board_walkable(b, to) ) {
+		return false;
+	}
+
+	memset(seen, 0, sizeof(uint64) * b->height);
+	board_set(seen, b->player);
+	queue[tail++]	= (uint16)b->player;
+
+	while( head < tail ) {
+		pos	= queue[head++];
+		if( pos == to ) {
+			break;
+		}
+
+		for( d = KEY_UP; d <= KEY_LEFT; ++d ) {
+			uint32	n	= pos + board_delta((KEY)d);
+			if( board_walkable(b, n) && !board_test(b->boxes, n) && !board_test(seen, n) ) {
+				board_set(seen, n);
+				came[n]			= (uint8)d;
+				queue[tail++]	= (uint16)n;
+			}
+		}
+	}
+
+	if( !board_test(seen, to) ) {
+		return false;
+	}
+
+	for( pos = to; pos != b->player; pos -= board_delta((KEY)came[pos]) ) {
+		path[len++]	= (KEY)came[pos];
+	}
+
+	while( len ) {
+		KEY	k	= path[--len];
+		board_step(b, k);
+		key_array_push(keys, k);
+	}
+
+	return true;
+}
+
+/* walk next to the box at 'box' and push it towards dir, appending the keys */
+bool
+board_push_keys(board_t* b, uint32 box, KEY dir, key_array_t* keys) {
+	if( !board_walk_to(b, box - board_delta(dir), keys) ) {
+		return false;
+	}
+
+	key_array_push(keys, dir);
+	return (board_step(b, dir) & MOVE_PUSH) != 0;
+}
+
+void
+level_release(level_t* lvl) {
+	free(lvl->cells);
+	lvl->cells	= NULL;
+	lvl->width	= 0;
+	lvl->height	= 0;
+}
+
+/* player part of the state hash: the player square, or the smallest square of its region */
+static uint32
+player_key_pos(const game_state_t* state) {
+	uint64	reach[BOARD_MAX_HEIGHT];
+
+	if( !state->normalize ) {
+		return state->board.player;
+	}
+	return board_reachable(&(state->board), state->board.player, reach);
+}
+
+static void
+rehash(game_state_t* state) {
+	state->box_hash		= board_boxes_hash(&(state->board));
+	state->player_key	= player_key_pos(state);
+	state->hash			= state->box_hash ^ zobrist_key(ZOBRIST_PLAYER, state->player_key);
+}
+
+bool
+game_init(game_state_t* state, const level_t* lvl, uint32 level_index) {
+	memset(state, 0, sizeof(game_state_t));
+
+	if( !board_from_level(&(state->initial), lvl) ) {
+		return false;
+	}
+
+	if( !board_allocate(&(state->board), lvl->width, lvl->height) ) {
+		board_release(&(state->initial));
+		return false;
+	}
+
+	board_copy(&(state->board), &(state->initial));
+
+	if( !lower_bound_init(&(state->bound), &(state->board)) ) {
+		board_release(&(state->initial));
+		board_release(&(state->board));
+		return false;
+	}
+
+	state->current_level	= level_index;
+	state->last_move		= MOVE_NONE;
+	state->log				= move_log_new();
+	state->played			= 0;
+	rehash(state);
+	return true;
+}
+
+void
+game_hash_normalize(game_state_t* state, bool normalize) {
+	state->normalize	= normalize;
+	rehash(state);
+}
+
+void
+game_release(game_state_t* state) {
+	board_release(&(state->initial));
+	board_release(&(state->board));
+	lower_bound_release(&(state->bound));
+	move_log_release(&(state->log));
+}
+
+/*
+ * keeps the lower bound and the hash in step after the board moved, box_from
+ * and box_to are the box squares of a push. A walk never changes the player
+ * region, so a normalized hash only needs the reachability flood after a
+ * push.
+ */
+static void
+moved(game_state_t* state, uint32 res, uint32 box_from, uint32 box_to) {
+	if( res & (MOVE_PUSH | MOVE_PULL) ) {
+		lower_bound_move(&(state->bound), box_from, box_to);
+		state->box_hash	^= zobrist_key(ZOBRIST_BOX, box_from) ^ zobrist_key(ZOBRIST_BOX, box_to);
+	}
+
+	if( !state->normalize ) {
+		state->player_key	= state->board.player;
+	} else if( res & (MOVE_PUSH | MOVE_PULL) ) {
+		state->player_key	= player_key_pos(state);
+	}
+
+	state->hash	= state->box_hash ^ zobrist_key(ZOBRIST_PLAYER, state->player_key);
+}
+
+static uint32
+step(game_state_t* state, KEY key) {
+	uint32	res		= board_step(&(state->board), key);
+	uint32	player	= state->board.player;
+
+	/* the player now stands where the box was */
+	if( res != MOVE_NONE ) {
+		moved(state, res, player, player + board_delta(key));
+	}
+	return res;
+}
+
+/* a box right behind the player is pulled along */
+static uint32
+pull(game_state_t* state, KEY key) {
+	uint32	player	= state->board.player;
+	uint32	res		= board_pull(&(state->board), key, true);
+
+	/* the box takes the square the player left */
+	if( res != MOVE_NONE ) {
+		moved(state, res, player - board_delta(key), player);
+	}
+	return res;
+}
+
+static uint32
+unstep(game_state_t* state, uint8 record) {
+	KEY		key		= (KEY)(record & MOVE_LOG_DIR);
+	uint32	player	= state->board.player;
+	uint32	delta	= board_delta(key);
+	uint32	res;
+
+	/* a pull is taken back by a step the other way, pushing the box back */
+	if( record & MOVE_LOG_PULL ) {
+		res	= board_step(&(state->board), (KEY)((key + 2) & MOVE_LOG_DIR));
+		moved(state, res, player - delta, player - delta - delta);
+		return res;
+	}
+
+	/* the box goes back to where the player stood */
+	res	= board_unstep(&(state->board), key, (record & MOVE_LOG_PUSH) != 0);
+	moved(state, res, player + delta, player);
+	return res;
+}
+
+static void
+log_move(game_state_t* state, KEY key, uint8 flags) {
+	/* a new move drops the redo part of the log */
+	state->log.count	= state->played;
+	move_log_push(&(state->log), (uint8)(key | flags));
+	++(state->played);
+}
+
+void
+game_next_state(game_state_t* state, KEY key) {
+	switch( key ) {
+	case KEY_UP:
+	case KEY_RIGHT:
+	case KEY_DOWN:
+	case KEY_LEFT:
+		state->last_move	= step(state, key);
+		if( state->last_move != MOVE_NONE ) {
+			log_move(state, key, (state->last_move & MOVE_PUSH) ? MOVE_LOG_PUSH : 0);
+		}
+		break;
+
+	case KEY_UNDO:
+		state->last_move	= MOVE_NONE;
+		if( state->played ) {
+			--(state->played);
+			state->last_move	= unstep(state, move_log_get(&(state->log), state->played));
+		}
+		break;
+
+	case KEY_REDO:
+		state->last_move	= MOVE_NONE;
+		if( state->played < state->log.count ) {
+			uint8	r	= move_log_get(&(state->log), state->played);
+			KEY		k	= (KEY)(r & MOVE_LOG_DIR);
+			state->last_move	= (r & MOVE_LOG_PULL) ? pull(state, k) : step(state, k);
+			++(state->played);
+		}
+		break;
+
+	case KEY_EXIT:
+		state->last_move	= MOVE_NONE;
+		break;
+	}
+}
+
+void
+game_pull_state(game_state_t* state, KEY key) {
+	if( key > KEY_LEFT ) {
+		game_next_state(state, key);
+		return;
+	}
+
+	state->last_move	= pull(state, key);
+	if( state->last_move != MOVE_NONE ) {
+		log_move(state, key, MOVE_LOG_PULL | ((state->last_move & MOVE_PULL) ? MOVE_LOG_PUSH : 0));
+	}
+}
@@ -0,0 +1,334 @@
+/*
+** BoxWorld Copyright 2016(c) Wael El Oraiby. All Rights Reserved
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** Under Section 7 of GPL version 3, you are granted additional
+** permissions described in the GCC Runtime Library Exception, version
+** 3.1, as published by the Free Software Foundation.
+**
+** You should have received a copy of the GNU General Public License and
+** a copy of the GCC Runtime Library Exception along with this program;
+** see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+** <http://www.gnu.org/licenses/>.
+**
+*/
+#include "boxworld.h"
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * procedural collection: every worker draws candidates (level_generate) and
+ * scores them with a bounded solver pass, the nodes it expanded being the
+ * difficulty. Candidates inside the difficulty range are kept unless their
+ * canonical fingerprint was already taken, until count levels are in or the
+ * workers drew max_candidates between them. They are written with their
+ * solution, in the order they were accepted.
+ */
+
+enum {
+	REJECT_ROOM,		/* level_generate gave up */
+	REJECT_BUDGET,		/* the solver ran out of time or memory */
+	REJECT_EASY,
+	REJECT_HARD,
+	REJECT_DUPLICATE,
+	REJECT_CANON,		/* level_canonical_fingerprint failed */
+	REJECT_COUNT,
+};
+
+static const char*	reject_names[REJECT_COUNT]	= { "room", "budget", "easy", "hard", "duplicate", "canon" };
+
+typedef struct {
+	level_t		level;
+	char*		solution;
+	uint32		pushes;
+	uint64		expanded;
+} generated_t;
+
+typedef struct {
+	generator_params_t	gen;
+	solver_params_t		solver;
+	uint64				min_effort;
+	uint64				max_effort;		/* 0 for no limit */
+	uint32				min_pushes;
+	uint64				seed;
+
+	pthread_mutex_t		lock;
+	generated_t*		levels;
+	uint32				count;			/* levels wanted */
+	uint64				max_candidates;
+	volatile uint32		accepted;
+	volatile uint64		drawn;			/* candidates claimed by all the workers */
+	uint64*				seen;			/* canonical fingerprints, open addressing, 0 is empty */
+	uint32				seen_mask;
+	uint64				candidates;
+	uint64				rejects[REJECT_COUNT];
+} levelgen_t;
+
+typedef struct {
+	levelgen_t*			g;
+	uint32				index;
+} worker_t;
+
+/* false when the fingerprint was already there */
+static bool
+seen_insert(levelgen_t* g, uint64 fingerprint) {
+	uint32	i	= (uint32)fingerprint & g->seen_mask;
+
+	while( g->seen[i] ) {
+		if( g->seen[i] == fingerprint ) {
+			return false;
+		}
+		i	= (i + 1) & g->seen_mask;
+	}
+	g->seen[i]	= fingerprint;
+	return true;
+}
+
+static void*
+levelgen_worker(void* arg) {
+	worker_t*		wk		= (worker_t*)arg;
+	levelgen_t*		g		= wk->g;
+	uint64			seed	= g->seed ^ ((uint64)(wk->index + 1) * 0x9E3779B97F4A7C15ull);
+	level_t			lvl		= { 0, 0, NULL };
+	key_array_t		keys	= key_array_new();
+	uint64			candidates	= 0;
+	uint64			rejects[REJECT_COUNT]	= {0};
+	uint32			r;
+
+	while( g->accepted < g->count && __sync_fetch_and_add(&(g->drawn), 1) < g->max_candidates ) {
+		solver_stats_t	st;
+		board_t			b;
+		uint64			fingerprint;
+		int				reject	= -1;
+
+		++candidates;
+		if( !level_generate(&(g->gen), &seed, &lvl) || !board_from_level(&b, &lvl) ) {
+			++rejects[REJECT_ROOM];
+			continue;
+		}
+
+		solver_solve_board(&b, &(g->solver), &keys, &st);
+		if( SOLVER_SOLVED != st.result ) {
+			reject	= REJECT_BUDGET;
+		} else if( st.expanded < g->min_effort || st.pushes < g->min_pushes ) {
+			reject	= REJECT_EASY;
+		} else if( g->max_effort && st.expanded > g->max_effort ) {
+			reject	= REJECT_HARD;
+		}
+
+		if( reject >= 0 ) {
+			++rejects[reject];
+			board_release(&b);
+			continue;
+		}
+
+		/* 0 can't go in the seen table, it marks the empty slots */
+		fingerprint	= level_canonical_fingerprint(&lvl);
+		if( 0 == fingerprint ) {
+			++rejects[REJECT_CANON];
+			board_release(&b);
+			continue;
+		}
+
+		pthread_mutex_lock(&(g->lock));
+		if( g->accepted < g->count && seen_insert(g, fingerprint) ) {
+			generated_t*	out	= &(g->levels[g->accepted]);
+
+			out->level		= lvl;
+			out->solution	= (char*)malloc(keys.count + 1);
+			out->pushes		= st.pushes;
+			out->expanded	= st.expanded;
+			if( out->solution ) {
+				lurd_write(&b, &keys, out->solution);
+			}
+
+			lvl.cells	= NULL;			/* owned by the collection now */
+			__sync_synchronize();
+			++(g->accepted);
+		} else {
+			++rejects[REJECT_DUPLICATE];
+		}
+		pthread_mutex_unlock(&(g->lock));
+
+		board_release(&b);
+	}
+
+	pthread_mutex_lock(&(g->lock));
+	g->candidates	+= candidates;
+	for( r = 0; r < REJECT_COUNT; ++r ) {
+		g->rejects[r]	+= rejects[r];
+	}
+	pthread_mutex_unlock(&(g->lock));
+
+	key_array_release(&keys);
+	level_release(&lvl);
+	return NULL;
+}
+
+static void
+usage(const char* name) {
+	generator_params_t	p	= generator_default_params();
+
+	fprintf(stderr, "usage: %s [options] <out.sok>\n", name);
+	fprintf(stderr, "\t-n\tlevels (default: 100)\n");
+	fprintf(stderr, "\t-c\tcandidates to draw before giving up (default: 1000 per level)\n");
+	fprintf(stderr, "\t-j\tworker threads (default: one per core)\n");
+	fprintf(stderr, "\t-W -H\troom size, walls included (default: %u x %u)\n", p.width, p.height);
+	fprintf(stderr, "\t-b\tboxes (default: %u)\n", p.boxes);
+	fprintf(stderr, "\t-w\tpercent of inner squares turned to walls (default: %u)\n", p.wall_percent);
+	fprintf(stderr, "\t-p\treverse moves from the goals (default: %u)\n", p.pulls);
+	fprintf(stderr, "\t-e -E\tmin and max solver nodes, the difficulty range (default: 200, no max)\n");
+	fprintf(stderr, "\t-P\tmin pushes (default: 10)\n");
+	fprintf(stderr, "\t-t\tsolver time limit per candidate (default: 1)\n");
+	fprintf(stderr, "\t-m\tsolver memory budget per candidate (default: 32)\n");
+	fprintf(stderr, "\t-s\tseed\n");
+}
+
+int
+main(int argc, char** argv) {
+	levelgen_t		g;
+	worker_t*		workers;
+	pthread_t*		threads_id;
+	const char*		out_path	= NULL;
+	uint32			threads		= (uint32)sysconf(_SC_NPROCESSORS_ONLN);
+	uint32			seen_size	= 64;
+	FILE*			out;
+	double			start, elapsed;
+	uint64			expanded	= 0;
+	uint32			i;
+	int				a;
+
+	memset(&g, 0, sizeof(levelgen_t));
+	g.gen				= generator_default_params();
+	g.solver			= solver_default_params();
+	g.solver.time_limit		= 1.0;
+	g.solver.memory_budget	= (size_t)32 << 20;
+	g.min_effort		= 200;
+	g.min_pushes		= 10;
+	g.count				= 100;
+	g.seed				= (uint64)time(NULL);
+
+	for( a = 1; a < argc; ++a ) {
+		if( argv[a][0] == '-' && argv[a][1] != '\0' && argv[a][2] == '\0' && a + 1 < argc ) {
+			const char*	v	= argv[++a];
+			switch( argv[a - 1][1] ) {
+			case 'n'	: g.count				= (uint32)atoi(v); break;
+			case 'c'	: g.max_candidates		= (uint64)atoll(v); break;
+			case 'j'	: threads				= (uint32)atoi(v); break;
+			case 'W'	: g.gen.width			= (uint32)atoi(v); break;
+			case 'H'	: g.gen.height			= (uint32)atoi(v); break;
+			case 'b'	: g.gen.boxes			= (uint32)atoi(v); break;
+			case 'w'	: g.gen.wall_percent	= (uint32)atoi(v); break;
+			case 'p'	: g.gen.pulls			= (uint32)atoi(v); break;
+			case 'e'	: g.min_effort			= (uint64)atoll(v); break;
+			case 'E'	: g.max_effort			= (uint64)atoll(v); break;
+			case 'P'	: g.min_pushes			= (uint32)atoi(v); break;
+			case 't'	: g.solver.time_limit	= atof(v); break;
+			case 'm'	: g.solver.memory_budget	= (size_t)atoi(v) << 20; break;
+			case 's'	: g.seed				= (uint64)atoll(v); break;
+			default		: usage(argv[0]); return EXIT_FAILURE;
+			}
+		} else if( NULL == out_path && argv[a][0] != '-' ) {
+			out_path	= argv[a];
+		} else {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if( NULL == out_path || 0 == g.count ) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if( g.max_effort && g.max_effort < g.min_effort ) {
+		fprintf(stderr, "%s: the max solver nodes (-E) is below the min (-e)\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if( 0 == g.max_candidates ) {
+		g.max_candidates	= (uint64)g.count * 1000;
+	}
+
+	threads	= MAX(threads, 1);
+	while( seen_size < g.count * 2 ) {
+		seen_size	<<= 1;
+	}
+
+	/* the freeze and corral patterns are shared by all the workers */
+	g.solver.deadlocks	= deadlock_cache_create(1 << 20);
+	g.levels	= (generated_t*)calloc(g.count, sizeof(generated_t));
+	g.seen		= (uint64*)calloc(seen_size, sizeof(uint64));
+	g.seen_mask	= seen_size - 1;
+	workers		= (worker_t*)malloc(sizeof(worker_t) * threads);
+	threads_id	= (pthread_t*)malloc(sizeof(pthread_t) * threads);
+	assert( NULL != g.levels && NULL != g.seen && NULL != workers && NULL != threads_id );
+	pthread_mutex_init(&(g.lock), NULL);
+
+	start	= boxworld_seconds();
+
+	/* the calling thread is the first worker */
+	for( i = 0; i < threads; ++i ) {
+		workers[i].g		= &g;
+		workers[i].index	= i;
+	}
+	for( i = 1; i < threads; ++i ) {
+		if( 0 != pthread_create(&(threads_id[i]), NULL, levelgen_worker, &(workers[i])) ) {
+			break;
+		}
+	}
+	threads	= i;
+	levelgen_worker(&(workers[0]));
+	for( i = 1; i < threads; ++i ) {
+		pthread_join(threads_id[i], NULL);
+	}
+
+	elapsed	= boxworld_seconds() - start;
+
+	out	= fopen(out_path, "w");
+	if( NULL == out ) {
+		fprintf(stderr, "unable to write %s\n", out_path);
+	} else {
+		for( i = 0; i < g.accepted; ++i ) {
+			const generated_t*	l	= &(g.levels[i]);
+
+			fprintf(out, "; %u: %u pushes, %llu nodes\n\n", i + 1, l->pushes, (unsigned long long)l->expanded);
+			level_write(out, &(l->level));
+			if( l->solution ) {
+				fprintf(out, "Solution: %s\n", l->solution);
+			}
+			fputc('\n', out);
+			expanded	+= l->expanded;
+		}
+		fclose(out);
+	}
+
+	fprintf(stderr, "%s: %u levels, %llu candidates, %u threads, %.3f s, %.1f levels/s, %.1f candidates/s\n",
+			out_path, g.accepted, (unsigned long long)g.candidates, threads, elapsed,
+			(double)g.accepted / MAX(elapsed, 1e-9), (double)g.candidates / MAX(elapsed, 1e-9));
+	fprintf(stderr, "%s: %.0f nodes per level, rejected:", out_path, (double)expanded / MAX(g.accepted, 1));
+	for( i = 0; i < REJECT_COUNT; ++i ) {
+		fprintf(stderr, " %llu %s%s", (unsigned long long)g.rejects[i], reject_names[i], i + 1 < REJECT_COUNT ? "," : "\n");
+	}
+	if( g.accepted < g.count ) {
+		fprintf(stderr, "%s: gave up after %llu candidates, %u of %u levels written\n",
+				out_path, (unsigned long long)g.max_candidates, g.accepted, g.count);
+	}
+
+	for( i = 0; i < g.accepted; ++i ) {
+		level_release(&(g.levels[i].level));
+		free(g.levels[i].solution);
+	}
+	pthread_mutex_destroy(&(g.lock));
+	deadlock_cache_release(g.solver.deadlocks);
+	free(g.levels);
+	free(g.seen);
+	free(workers);
+	free(threads_id);
+	return out && g.accepted == g.count ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,263 @@
+/*
+** BoxWorld Copyright 2016(c) Wael El Oraiby. All Rights Reserved
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** Under Section 7 of GPL version 3, you are granted additional
+** permissions described in the GCC Runtime Library Exception, version
+** 3.1, as published by the Free Software Foundation.
+**
+** You should have received a copy of the GNU General Public License and
+** a copy of the GCC Runtime Library Exception along with this program;
+** see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+** <http://www.gnu.org/licenses/>.
+**
+*/
+#include "boxworld.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+enum {
+	HEADER_SIZE			= 16,	/* magic, version, count, max_cells */
+	PAYLOAD_HEADER_SIZE	= 4,	/* uint16 width, uint16 height */
+};
+
+static INLINE uint32
+get_le32(const uint8* b) {
+	return (uint32)b[0] | ((uint32)b[1] << 8) | ((uint32)b[2] << 16) | ((uint32)b[3] << 24);
+}
+
+static INLINE uint64
+get_le64(const uint8* b) {
+	return (uint64)get_le32(b) | ((uint64)get_le32(b + 4) << 32);
+}
+
+static INLINE void
+put_le32(uint8* b, uint32 v) {
+	b[0]	= (uint8)v;
+	b[1]	= (uint8)(v >> 8);
+	b[2]	= (uint8)(v >> 16);
+	b[3]	= (uint8)(v >> 24);
+}
+
+static INLINE void
+put_le64(uint8* b, uint64 v) {
+	put_le32(b, (uint32)v);
+	put_le32(b + 4, (uint32)(v >> 32));
+}
+
+static size_t
+payload_size(uint32 width, uint32 height) {
+	return PAYLOAD_HEADER_SIZE + ((size_t)width * height + 1) / 2;
+}
+
+levelpack_t*
+levelpack_open(const char* path) {
+	int							fd;
+	struct stat					st;
+	void*						data;
+	const uint8*				hdr;
+	uint32						count;
+	levelpack_t*				pack;
+	size_t						table_end;
+	char						error_buff[MAX_ERROR_LENGTH]	= {0};
+
+	fd	= open(path, O_RDONLY);
+	if( fd < 0 ) {
+		snprintf(error_buff, MAX_ERROR_LENGTH, "levelpack_open: %s not found", path);
+		return (levelpack_t*)boxworld_error(FILE_NOT_FOUND, error_buff);
+	}
+
+	if( fstat(fd, &st) != 0 || (size_t)st.st_size < HEADER_SIZE ) {
+		close(fd);
+		snprintf(error_buff, MAX_ERROR_LENGTH, "levelpack_open: %s is not a level pack", path);
+		return (levelpack_t*)boxworld_error(INVALID_FORMAT, error_buff);
+	}
+
+	data	= mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if( MAP_FAILED == data ) {
+		snprintf(error_buff, MAX_ERROR_LENGTH, "levelpack_open: unable to map %s", path);
+		return (levelpack_t*)boxworld_error(LOAD_FAILED, error_buff);
+	}
+
+	hdr			= (const uint8*)data;
+	count		= get_le32(hdr + 8);
+	table_end	= HEADER_SIZE + sizeof(uint64) * ((size_t)count + 1);
+
+	if( memcmp(hdr, LEVELPACK_MAGIC, 4) != 0 ||
+		get_le32(hdr + 4) != LEVELPACK_VERSION ||
+		table_end > (size_t)st.st_size ) {
+		munmap(data, (size_t)st.st_size);
+		snprintf(error_buff, MAX_ERROR_LENGTH, "levelpack_open: %s is not a level pack", path);
+		return (levelpack_t*)boxworld_error(INVALID_FORMAT, error_buff);
+	}
+
+	pack	= (levelpack_t*)malloc(sizeof(levelpack_t));
+	if( NULL == pack ) {
+		munmap(data, (size_t)st.st_size);
+		return (levelpack_t*)boxworld_error(NOT_ENOUGH_MEMORY, "levelpack_open: not enough memory");
+	}
+
+	pack->data		= (const uint8*)data;
+	pack->size		= (size_t)st.st_size;
+	pack->count		= count;
+	pack->max_cells	= get_le32(hdr + 12);
+	pack->offsets	= pack->data + HEADER_SIZE;
+	return pack;
+}
+
+void
+levelpack_close(levelpack_t* pack) {
+	munmap((void*)pack->data, pack->size);
+	free(pack);
+}
+
+/*
+ * decode level index into lvl. lvl->cells is reused and must hold at least
+ * pack->max_cells cells; when NULL it's allocated with that size, so switching
+ * levels never allocates again.
+ */
+bool
+levelpack_level(const levelpack_t* pack, uint32 index, level_t* lvl) {
+	uint64			start, end;
+	const uint8*	payload;
+	uint32			width, height;
+	uint32			c, count;
+
+	if( index >= pack->count ) {
+		boxworld_error(INVALID_FORMAT, "levelpack_level: level index out of range");
+		return false;
+	}
+
+	start	= get_le64(pack->offsets + sizeof(uint64) * index);
+	end		= get_le64(pack->offsets + sizeof(uint64) * (index + 1));
+	if( start > end || end > pack->size || end - start < PAYLOAD_HEADER_SIZE ) {
+		boxworld_error(INVALID_FORMAT, "levelpack_level: corrupted offset table");
+		return false;
+	}
+
+	payload	= pack->data + start;
+	width	= (uint32)payload[0] | ((uint32)payload[1] << 8);
+	height	= (uint32)payload[2] | ((uint32)payload[3] << 8);
+	count	= width * height;
+
+	if( payload_size(width, height) != end - start || count > pack->max_cells ) {
+		boxworld_error(INVALID_FORMAT, "levelpack_level: corrupted level payload");
+		return false;
+	}
+
+	if( NULL == lvl->cells ) {
+		lvl->cells	= (cell_t*)malloc(sizeof(cell_t) * MAX(pack->max_cells, 1));
+		if( NULL == lvl->cells ) {
+			boxworld_error(NOT_ENOUGH_MEMORY, "levelpack_level: not enough memory");
+			return false;
+		}
+	}
+
+	lvl->width	= width;
+	lvl->height	= height;
+
+	payload	+= PAYLOAD_HEADER_SIZE;
+	for( c = 0; c < count; ++c ) {
+		uint8	nib	= (uint8)(payload[c >> 1] >> ((c & 1) << 2));
+		lvl->cells[c].bg	= (BACKGROUND)(nib & 3);
+		lvl->cells[c].actor	= (ACTOR)((nib >> 2) & 3);
+	}
+
+	return true;
+}
+
+bool
+levelpack_write(const char* path, const level_collection_t* coll) {
+	FILE*				f;
+	levelpack_header_t	hdr;
+	uint8				bytes[HEADER_SIZE];
+	uint64				offset;
+	uint8*				buff		= NULL;
+	size_t				buff_size	= 0;
+	uint32				l;
+	char				error_buff[MAX_ERROR_LENGTH]	= {0};
+
+	memcpy(hdr.magic, LEVELPACK_MAGIC, 4);
+	hdr.version		= LEVELPACK_VERSION;
+	hdr.count		= coll->count;
+	hdr.max_cells	= 0;
+
+	for( l = 0; l < coll->count; ++l ) {
+		const level_t*	lvl	= &(coll->levels[l]);
+		if( lvl->width > 0xFFFF || lvl->height > 0xFFFF ) {
+			boxworld_error(UNSUPPORTED, "levelpack_write: level is too big");
+			return false;
+		}
+		hdr.max_cells	= MAX(hdr.max_cells, lvl->width * lvl->height);
+	}
+
+	f	= fopen(path, "wb");
+	if( NULL == f ) {
+		snprintf(error_buff, MAX_ERROR_LENGTH, "levelpack_write: unable to create %s", path);
+		boxworld_error(LOAD_FAILED, error_buff);
+		return false;
+	}
+
+	memcpy(bytes, hdr.magic, 4);
+	put_le32(bytes + 4, hdr.version);
+	put_le32(bytes + 8, hdr.count);
+	put_le32(bytes + 12, hdr.max_cells);
+	fwrite(bytes, HEADER_SIZE, 1, f);
+
+	/* offset table */
+	offset	= HEADER_SIZE + sizeof(uint64) * ((uint64)coll->count + 1);
+	for( l = 0; l <= coll->count; ++l ) {
+		put_le64(bytes, offset);
+		fwrite(bytes, sizeof(uint64), 1, f);
+		if( l < coll->count ) {
+			offset	+= payload_size(coll->levels[l].width, coll->levels[l].height);
+		}
+	}
+
+	/* payloads */
+	for( l = 0; l < coll->count; ++l ) {
+		const level_t*	lvl		= &(coll->levels[l]);
+		size_t			size	= payload_size(lvl->width, lvl->height);
+		uint32			count	= lvl->width * lvl->height;
+		uint32			c;
+
+		if( size > buff_size ) {
+			buff		= (uint8*)realloc(buff, size);
+			buff_size	= size;
+			assert( NULL != buff );
+		}
+
+		memset(buff, 0, size);
+		buff[0]	= (uint8)(lvl->width & 0xFF);
+		buff[1]	= (uint8)(lvl->width >> 8);
+		buff[2]	= (uint8)(lvl->height & 0xFF);
+		buff[3]	= (uint8)(lvl->height >> 8);
+
+		for( c = 0; c < count; ++c ) {
+			uint8	nib	= (uint8)((lvl->cells[c].bg & 3) | ((lvl->cells[c].actor & 3) << 2));
+			buff[PAYLOAD_HEADER_SIZE + (c >> 1)]	|= (uint8)(nib << ((c & 1) << 2));
+		}
+
+		fwrite(buff, size, 1, f);
+	}
+
+	free(buff);
+
+	if( ferror(f) ) {
+		fclose(f);
+		snprintf(error_buff, MAX_ERROR_LENGTH, "levelpack_write: failed writing %s", path);
+		boxworld_error(LOAD_FAILED, error_buff);
+		return false;
+	}
+
+	fclose(f);
+	return true;
+}
@@ -0,0 +1,246 @@
+/*
+** BoxWorld Copyright 2016(c) Wael El Oraiby. All Rights Reserved
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** Under Section 7 of GPL version 3, you are granted additional
+** permissions described in the GCC Runtime Library Exception, version
+** 3.1, as published by the Free Software Foundation.
+**
+** You should have received a copy of the GNU General Public License and
+** a copy of the GCC Runtime Library Exception along with this program;
+** see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+** <http://www.gnu.org/licenses/>.
+**
+*/
+#include "boxworld.h"
+
+/*
+ * minimum pushes remaining: the cheapest assignment of boxes (rows) to goals
+ * (columns), each pair costing the push distance from the box to that goal
+ * with every other box ignored.
+ *
+ * The assignment is kept by the hungarian algorithm with its dual potentials.
+ * When a box moves only its row changes: the row is taken out of the
+ * matching, its potential reset, and a single augmenting path search puts it
+ * back. That's O(boxes^2) per push on the dense cost matrix, with no
+ * allocation. The costs are never stored, they are read from the per goal
+ * distance tables.
+ *
+ * Rows and columns are 1 based, column 0 is the root of the augmenting path
+ * search.
+ */
+
+static const int64_t	INF	= (int64_t)1 << 62;
+
+static uint32
+cost(const lower_bound_t* lb, uint32 row, uint32 col) {
+	uint16	d	= lb->dist[(size_t)(col - 1) * lb->cells + lb->boxes[row - 1]];
+	return BOARD_DIST_INF == d ? lb->inf_cost : d;
+}
+
+/* pushes from every cell to the goal at 'goal', the box is pulled away from it */
+static void
+goal_distances(const board_t* b, uint32 goal, uint16* dist) {
+	uint16		queue[BOARD_MAX_CELLS];
+	uint32		head	= 0;
+	uint32		tail	= 0;
+	uint32		i, d;
+
+	for( i = 0; i < (b->height << BOARD_SHIFT); ++i ) {
+		dist[i]	= BOARD_DIST_INF;
+	}
+
+	dist[goal]		= 0;
+	queue[tail++]	= (uint16)goal;
+
+	while( head < tail ) {
+		uint32	pos	= queue[head++];
+		for( d = KEY_UP; d <= KEY_LEFT; ++d ) {
+			uint32	delta	= board_delta((KEY)d);
+			uint32	from	= pos - delta;
+			if( board_walkable(b, from) && board_walkable(b, from - delta) && dist[from] == BOARD_DIST_INF ) {
+				dist[from]		= (uint16)(dist[pos] + 1);
+				queue[tail++]	= (uint16)from;
+			}
+		}
+	}
+}
+
+/* hungarian phase: matches the free row 'row' along the cheapest augmenting path */
+static void
+augment(lower_bound_t* lb, uint32 row) {
+	uint32	n		= lb->box_count;
+	uint32	col		= 0;
+	uint32	j;
+
+	for( j = 0; j <= n; ++j ) {
+		lb->minv[j]	= INF;
+		lb->used[j]	= 0;
+	}
+
+	lb->match[0]	= row;
+	do {
+		uint32	r		= lb->match[col];
+		uint32	next	= 0;
+		int64_t	delta	= INF;
+
+		lb->used[col]	= 1;
+		for( j = 1; j <= n; ++j ) {
+			int64_t	cur;
+
+			if( lb->used[j] ) {
+				continue;
+			}
+
+			cur	= (int64_t)cost(lb, r, j) - lb->u[r] - lb->v[j];
+			if( cur < lb->minv[j] ) {
+				lb->minv[j]	= cur;
+				lb->way[j]	= col;
+			}
+			if( lb->minv[j] < delta ) {
+				delta	= lb->minv[j];
+				next	= j;
+			}
+		}
+
+		for( j = 0; j <= n; ++j ) {
+			if( lb->used[j] ) {
+				lb->u[lb->match[j]]	+= delta;
+				lb->v[j]			-= delta;
+			} else {
+				lb->minv[j]	-= delta;
+			}
+		}
+
+		col	= next;
+	} while( lb->match[col] != 0 );
+
+	/* flip the path back to the root */
+	do {
+		uint32	prev	= lb->way[col];
+		lb->match[col]	= lb->match[prev];
+		lb->assigned[lb->match[col]]	= col;
+		col	= prev;
+	} while( col != 0 );
+}
+
+static void
+update_value(lower_bound_t* lb) {
+	uint64	total	= 0;
+	uint32	r;
+
+	for( r = 1; r <= lb->box_count; ++r ) {
+		total	+= cost(lb, r, lb->assigned[r]);
+	}
+
+	/* a single unreachable goal costs more than any complete assignment */
+	lb->value	= total >= lb->inf_cost ? LOWER_BOUND_INF : (uint32)total;
+}
+
+bool
+lower_bound_init(lower_bound_t* lb, const board_t* b) {
+	uint32	n		= b->box_count;
+	uint32	cells	= b->height << BOARD_SHIFT;
+	size_t	size;
+	uint8*	mem;
+	uint32	y, g;
+
+	memset(lb, 0, sizeof(lower_bound_t));
+
+	size	= sizeof(uint16) * ((size_t)n * cells + n) +		/* distance tables, boxes */
+			  sizeof(int64_t) * (n + 1) * 3 +					/* u, v, minv */
+			  sizeof(uint32) * (n + 1) * 3 +				/* match, assigned, way */
+			  sizeof(uint8) * (n + 1);						/* used */
+
+	mem	= (uint8*)malloc(size);
+	if( NULL == mem ) {
+		boxworld_error(NOT_ENOUGH_MEMORY, "lower_bound_init: not enough memory");
+		return false;
+	}
+
+	/* widest types first, so every array stays aligned */
+	lb->u			= (int64_t*)mem;
+	lb->v			= lb->u + n + 1;
+	lb->minv		= lb->v + n + 1;
+	lb->match		= (uint32*)(lb->minv + n + 1);
+	lb->assigned	= lb->match + n + 1;
+	lb->way			= lb->assigned + n + 1;
+	lb->dist		= (uint16*)(lb->way + n + 1);
+	lb->boxes		= lb->dist + (size_t)n * cells;
+	lb->used		= (uint8*)(lb->boxes + n);
+
+	lb->box_count	= n;
+	lb->cells		= cells;
+	lb->inf_cost	= n * BOARD_MAX_CELLS + 1;
+
+	for( y = 0, g = 0; y < b->height; ++y ) {
+		uint64	row	= b->goals[y];
+		while( row ) {
+			goal_distances(b, board_pos((uint32)__builtin_ctzll(row), y), lb->dist + (size_t)(g++) * cells);
+			row	&= row - 1;
+		}
+	}
+
+	lower_bound_reset(lb, b);
+	return true;
+}
+
+void
+lower_bound_release(lower_bound_t* lb) {
+	free(lb->u);
+	memset(lb, 0, sizeof(lower_bound_t));
+}
+
+void
+lower_bound_reset(lower_bound_t* lb, const board_t* b) {
+	uint32	n	= lb->box_count;
+	uint32	y, r;
+
+	for( y = 0, r = 0; y < b->height; ++y ) {
+		uint64	row	= b->boxes[y];
+		while( row ) {
+			lb->boxes[r++]	= (uint16)board_pos((uint32)__builtin_ctzll(row), y);
+			row	&= row - 1;
+		}
+	}
+
+	memset(lb->u, 0, sizeof(int64_t) * (n + 1));
+	memset(lb->v, 0, sizeof(int64_t) * (n + 1));
+	memset(lb->match, 0, sizeof(uint32) * (n + 1));
+	memset(lb->assigned, 0, sizeof(uint32) * (n + 1));
+
+	for( r = 1; r <= n; ++r ) {
+		augment(lb, r);
+	}
+
+	update_value(lb);
+}
+
+void
+lower_bound_move(lower_bound_t* lb, uint32 from, uint32 to) {
+	uint32	r;
+
+	for( r = 1; r <= lb->box_count; ++r ) {
+		if( lb->boxes[r - 1] == from ) {
+			break;
+		}
+	}
+
+	assert( r <= lb->box_count );
+
+	/*
+	 * every column potential only ever decreases from 0 and costs are never
+	 * negative, so a zero row potential keeps the duals feasible
+	 */
+	lb->boxes[r - 1]				= (uint16)to;
+	lb->match[lb->assigned[r]]	= 0;
+	lb->assigned[r]				= 0;
+	lb->u[r]					= 0;
+
+	augment(lb, r);
+	update_value(lb);
+}
@@ -0,0 +1,215 @@
+/*
+** BoxWorld Copyright 2016(c) Wael El Oraiby. All Rights Reserved
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** Under Section 7 of GPL version 3, you are granted additional
+** permissions described in the GCC Runtime Library Exception, version
+** 3.1, as published by the Free Software Foundation.
+**
+** You should have received a copy of the GNU General Public License and
+** a copy of the GCC Runtime Library Exception along with this program;
+** see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+** <http://www.gnu.org/licenses/>.
+**
+*/
+#include "boxworld.h"
+#include <pthread.h>
+
+/*
+ * LURD solution checks. Moves are played with board_step, the same step
+ * game_next_state uses, straight from the string: a byte table classifies
+ * each character, and nothing is allocated once the board is built.
+ * Letter case isn't checked, a push written in lower case (or a walk in
+ * upper case) is still played. A run length may prefix a move ("3l"),
+ * blanks are skipped.
+ */
+
+enum {
+	CH_BAD		= 0,		/* anything missing from the table */
+	CH_MOVE		= 1,		/* KEY_UP..KEY_LEFT are stored + CH_MOVE */
+	CH_DIGIT	= 8,
+	CH_BLANK	= 9,
+	MAX_THREADS	= 256,
+	BATCH_CHUNK	= 16,		/* jobs claimed by a worker at a time */
+};
+
+static const char	push_chars[]	= "URDL";
+static const char	walk_chars[]	= "urdl";
+
+static const uint8	char_class[256]	= {
+	['u'] = CH_MOVE + KEY_UP,	['U'] = CH_MOVE + KEY_UP,
+	['r'] = CH_MOVE + KEY_RIGHT,	['R'] = CH_MOVE + KEY_RIGHT,
+	['d'] = CH_MOVE + KEY_DOWN,	['D'] = CH_MOVE + KEY_DOWN,
+	['l'] = CH_MOVE + KEY_LEFT,	['L'] = CH_MOVE + KEY_LEFT,
+	['0'] = CH_DIGIT, ['1'] = CH_DIGIT, ['2'] = CH_DIGIT, ['3'] = CH_DIGIT, ['4'] = CH_DIGIT,
+	['5'] = CH_DIGIT, ['6'] = CH_DIGIT, ['7'] = CH_DIGIT, ['8'] = CH_DIGIT, ['9'] = CH_DIGIT,
+	[' '] = CH_BLANK, ['\t'] = CH_BLANK, ['\r'] = CH_BLANK, ['\n'] = CH_BLANK,
+};
+
+const char*
+lurd_result_string(LURD_RESULT res) {
+	switch( res ) {
+	case LURD_SOLVED		: return "solved";
+	case LURD_NOT_SOLVED	: return "not solved";
+	case LURD_ILLEGAL_MOVE	: return "illegal move";
+	case LURD_BAD_MOVE		: return "bad move";
+	case LURD_INVALID_LEVEL	: return "invalid level";
+	}
+	return "unknown";
+}
+
+LURD_RESULT
+lurd_play(board_t* b, const char* moves, size_t len, lurd_report_t* report) {
+	const uint8*	c		= (const uint8*)moves;
+	const uint8*	end		= c + len;
+	uint32			run		= 0;
+	uint32			count	= 0;
+	uint32			pushes	= 0;
+	LURD_RESULT		res		= LURD_SOLVED;
+
+	for( ; c < end; ++c ) {
+		uint8	k	= char_class[*c];
+
+		if( k >= CH_MOVE && k <= CH_MOVE + KEY_LEFT ) {
+			uint32	n	= MAX(run, 1);
+			run	= 0;
+			while( n-- ) {
+				uint32	step	= board_step(b, (KEY)(k - CH_MOVE));
+				if( MOVE_NONE == step ) {
+					res	= LURD_ILLEGAL_MOVE;
+					goto done;
+				}
+				++count;
+				pushes	+= (step >> 1) & 1;		/* MOVE_PUSH */
+			}
+		} else if( CH_DIGIT == k ) {
+			run	= run * 10 + (*c - '0');
+			if( run > 0xFFFFFF ) {
+				res	= LURD_BAD_MOVE;
+				goto done;
+			}
+		} else if( CH_BLANK != k || run ) {
+			res	= LURD_BAD_MOVE;
+			goto done;
+		}
+	}
+
+	if( run ) {
+		res	= LURD_BAD_MOVE;		/* trailing run length */
+	} else if( !board_solved(b) ) {
+		res	= LURD_NOT_SOLVED;
+	}
+
+done:
+	if( report ) {
+		report->result		= res;
+		report->moves		= count;
+		report->pushes		= pushes;
+		report->error_at	= LURD_SOLVED == res || LURD_NOT_SOLVED == res ? (uint32)len : (uint32)(c - (const uint8*)moves);
+	}
+	return res;
+}
+
+LURD_RESULT
+lurd_verify(const level_t* lvl, const char* moves, size_t len, lurd_report_t* report) {
+	board_t		b;
+	LURD_RESULT	res;
+
+	if( !board_from_level(&b, lvl) ) {
+		if( report ) {
+			memset(report, 0, sizeof(lurd_report_t));
+			report->result	= LURD_INVALID_LEVEL;
+		}
+		return LURD_INVALID_LEVEL;
+	}
+
+	res	= lurd_play(&b, moves, len, report);
+	board_release(&b);
+	return res;
+}
+
+size_t
+lurd_write(const board_t* start, const key_array_t* keys, char* out) {
+	board_t		b;
+	size_t		k;
+
+	if( !board_allocate(&b, start->width, start->height) ) {
+		return 0;
+	}
+	board_copy(&b, start);
+
+	for( k = 0; k < keys->count; ++k ) {
+		KEY		key		= keys->array[k];
+		uint32	step	= board_step(&b, key);
+		out[k]	= (step & MOVE_PUSH) ? push_chars[key] : walk_chars[key];
+	}
+
+	out[keys->count]	= '\0';
+	board_release(&b);
+	return keys->count;
+}
+
+typedef struct {
+	const lurd_job_t*	jobs;
+	lurd_report_t*		reports;
+	uint32				count;
+	volatile uint32		next;
+} batch_t;
+
+static void*
+batch_worker(void* arg) {
+	batch_t*	bt	= (batch_t*)arg;
+
+	for( ;; ) {
+		uint32	first	= __sync_fetch_and_add(&(bt->next), BATCH_CHUNK);
+		uint32	i;
+
+		if( first >= bt->count ) {
+			break;
+		}
+
+		for( i = first; i < MIN(first + BATCH_CHUNK, bt->count); ++i ) {
+			const lurd_job_t*	j	= &(bt->jobs[i]);
+			lurd_verify(j->level, j->moves, j->length, &(bt->reports[i]));
+		}
+	}
+
+	return NULL;
+}
+
+uint32
+lurd_verify_batch(const lurd_job_t* jobs, uint32 count, uint32 threads, lurd_report_t* reports) {
+	pthread_t	workers[MAX_THREADS];
+	batch_t		bt;
+	uint32		solved	= 0;
+	uint32		i;
+
+	bt.jobs		= jobs;
+	bt.reports	= reports;
+	bt.count	= count;
+	bt.next		= 0;
+
+	threads	= MIN(MAX(threads, 1), MIN(count, (uint32)MAX_THREADS));
+
+	/* the calling thread is the first worker */
+	for( i = 1; i < threads; ++i ) {
+		if( 0 != pthread_create(&(workers[i]), NULL, batch_worker, &bt) ) {
+			break;
+		}
+	}
+	threads	= i;
+	batch_worker(&bt);
+
+	for( i = 1; i < threads; ++i ) {
+		pthread_join(workers[i], NULL);
+	}
+
+	for( i = 0; i < count; ++i ) {
+		solved	+= LURD_SOLVED == reports[i].result;
+	}
+	return solved;
+}
@@ -26,45 +26,200 @@
 #include FT_FREETYPE_H
 #include FT_GLYPH_H
 
-static char				bworld_error_string[MAX_ERROR_LENGTH]	= {0};
-static BOXWORLD_ERROR	bworld_error							= NO_ERROR;
+static void
+error_callback(int error, const char* description) {
+	fputs(description, stderr);
+}
 
-void*
-boxworld_error(BOXWORLD_ERROR err, const char* string) {
-	size_t sl		= strlen(string);
+typedef struct {
+	level_collection_t*	coll;
+	game_state_t		state;
+	hint_worker_t*		hints;			/* NULL when the worker couldn't start */
+	uint32				requested;		/* generation of the last hint_request */
+	hint_t				hint;			/* the last one read, kept when a read is torn */
+} game_t;
+
+static const char*	dir_names[]	= { "up", "right", "down", "left" };
+
+static void
+key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+	game_t*	g	= (game_t*)glfwGetWindowUserPointer(window);
+	KEY		k;
 
-	if( sl >= MAX_ERROR_LENGTH ) {
-		exit(1);
+	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
+		glfwSetWindowShouldClose(window, GL_TRUE);
+
+	if( NULL == g || (action != GLFW_PRESS && action != GLFW_REPEAT) ) {
+		return;
 	}
 
-	bworld_error	= err;
-	memcpy(bworld_error_string, string, sl);
+	switch( key ) {
+	case GLFW_KEY_UP		: k = KEY_UP;		break;
+	case GLFW_KEY_RIGHT		: k = KEY_RIGHT;	break;
+	case GLFW_KEY_DOWN		: k = KEY_DOWN;		break;
+	case GLFW_KEY_LEFT		: k = KEY_LEFT;		break;
+	case GLFW_KEY_U			:
+	case GLFW_KEY_BACKSPACE	: k = KEY_UNDO;		break;
+	case GLFW_KEY_R			: k = KEY_REDO;		break;
+	default					: return;
+	}
 
-	return NULL;
+	game_next_state(&(g->state), k);
+
+	/* restarts the hint search when the position changed, it doesn't wait for the one under way */
+	if( g->hints && MOVE_NONE != g->state.last_move ) {
+		g->requested	= hint_request(g->hints, &(g->state.board));
+	}
 }
 
-BOXWORLD_ERROR		boxworld_error_number()	{ return bworld_error; }
-extern const char*	boxworld_error_string()	{ return bworld_error_string; }
+/* the board as text, followed by the hint line */
+static void
+render_game(gfx_context_t* ctx, const font_t* fnt, game_t* g) {
+	const board_t*	b	= &(g->state.board);
+	char			text[BOARD_MAX_CELLS + BOARD_MAX_HEIGHT + 256];
+	uint32			len	= 0;
+	uint32			x, y;
+
+	for( y = 0; y < b->height; ++y ) {
+		for( x = 0; x < b->width; ++x ) {
+			uint32	p		= board_pos(x, y);
+			bool	goal	= board_test(b->goals, p);
+
+			if( board_test(b->walls, p) ) {
+				text[len++]	= '#';
+			} else if( board_test(b->boxes, p) ) {
+				text[len++]	= goal ? '*' : '$';
+			} else if( p == b->player ) {
+				text[len++]	= goal ? '+' : '@';
+			} else {
+				text[len++]	= goal ? '.' : ' ';
+			}
+		}
+		text[len++]	= '\n';
+	}
+
+	if( g->hints ) {
+		hint_latest(g->hints, &(g->hint));
+	}
+
+	if( NULL == g->hints ) {
+		len	+= (uint32)snprintf(text + len, sizeof(text) - len, "\nno hints");
+	} else if( g->hint.generation != g->requested ) {
+		len	+= (uint32)snprintf(text + len, sizeof(text) - len, "\nhint: thinking...");
+	} else if( HINT_PUSH == g->hint.status ) {
+		len	+= (uint32)snprintf(text + len, sizeof(text) - len, "\nhint: push the box at %u,%u %s, %u pushes left (%.1f ms)",
+							   board_x(g->hint.box), board_y(g->hint.box), dir_names[g->hint.dir], g->hint.pushes,
+							   g->hint.latency * 1e3);
+	} else {
+		len	+= (uint32)snprintf(text + len, sizeof(text) - len, "\nhint: %s (%.1f ms)",
+							   hint_status_string(g->hint.status), g->hint.latency * 1e3);
+	}
 
+	font_render_utf8(ctx, fnt, vec2(16.0f, 32.0f), MIN(len, (uint32)sizeof(text) - 1), (const uint8*)text, color4(1.0f, 1.0f, 1.0f, 1.0f));
+}
+
+/*
+ * sprite throughput: frames of count small quads each, drawn until a second
+ * went by. glFinish closes every frame so the time includes the GPU side.
+ * The quads alternate between the first and the last texture, which the
+ * draw list has to merge back into a few batches
+ */
 static void
-error_callback(int error, const char* description) {
-	fputs(description, stderr);
+bench_frames(GLFWwindow* window, gfx_context_t* ctx, uint32 count) {
+	uint32	frames	= 0;
+	double	start	= 0.0, elapsed	= 0.0;
+	uint32	draws	= 0;
+	int		width, height;
+
+	glfwGetFramebufferSize(window, &width, &height);
+
+	/* the first frame is a warm up */
+	while( frames < 4 || elapsed < 1.0 ) {
+		uint32	q;
+
+		glClear(GL_COLOR_BUFFER_BIT);
+		renderer_begin(ctx, width, height);
+		for( q = 0; q < count; ++q ) {
+			float	x	= (float)((q * 16) % (uint32)MAX(width, 16));
+			float	y	= (float)(((q * 16) / (uint32)MAX(width, 16)) * 4 % (uint32)MAX(height, 16));
+			renderer_set_texture(ctx, (q & 1) ? ctx->numTextures - 1 : 0);
+			renderer_quad(ctx,
+						  vec2(x, y), vec2(0.0f, 0.0f),
+						  vec2(x + 16.0f, y + 16.0f), vec2(1.0f, 1.0f),
+						  color4((float)(q & 255) / 255.0f, 1.0f, 1.0f, 0.5f));
+		}
+		renderer_end(ctx);
+		glFinish();
+		glfwPollEvents();
+		draws	+= ctx->drawCalls;
+
+		if( 0.0 == start ) {
+			draws	= 0;
+			start	= boxworld_seconds();
+		} else {
+			++frames;
+		}
+		elapsed	= boxworld_seconds() - start;
+	}
+
+	printf("%s %8u quads/frame: %u frames, %.2f ms/frame, %.0f quads/s, %.1f draw calls/frame\n", ctx->instanced ? "instanced" : "vertices ",
+		   count, frames, elapsed * 1000.0 / frames, (double)count * frames / elapsed, (double)draws / frames);
 }
 
+/* the vertex path, then the instanced one */
 static void
-key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
-	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
-		glfwSetWindowShouldClose(window, GL_TRUE);
+bench_quads(GLFWwindow* window, gfx_context_t* ctx) {
+	static const uint32	counts[]	= { 10000, 100000, 1000000 };
+	bool				had			= ctx->instanced;
+	uint32				c;
+
+	renderer_set_instanced(ctx, false);
+	for( c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c ) {
+		bench_frames(window, ctx, counts[c]);
+	}
+
+	if( renderer_set_instanced(ctx, true) ) {
+		for( c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c ) {
+			bench_frames(window, ctx, counts[c]);
+		}
+	} else {
+		printf("instancing is not available\n");
+	}
+
+	renderer_set_instanced(ctx, had);
 }
 
 int
-main(void) {
+main(int argc, char** argv) {
 	GLFWwindow*		window	= NULL;
 	image_t*		tex	= NULL;
 	font_t*			fnt	= NULL;
 	gfx_context_t*	ctx	= NULL;
+	uint32			tiles	= 0;
+	game_t*			game	= NULL;
 	static uint32	chars[128 - 32];
 	uint32			i;
+	bool			bench	= argc > 1 && 0 == strcmp(argv[1], "-bench");
+
+	/* a collection on the command line is played, starting with its first level */
+	if( argc > 1 && !bench ) {
+		solver_params_t	params	= solver_default_params();
+
+		game	= (game_t*)calloc(1, sizeof(game_t));
+		assert( NULL != game );
+
+		game->coll	= level_collection_load(argv[1]);
+		if( NULL == game->coll || 0 == game->coll->count || !game_init(&(game->state), &(game->coll->levels[0]), 0) ) {
+			fprintf(stderr, "unable to load %s:\n%s\n", argv[1], boxworld_error_string());
+			exit(EXIT_FAILURE);
+		}
+
+		params.time_limit	= 10.0;
+		game->hints	= hint_worker_create(&(game->coll->levels[0]), &params);
+		if( game->hints ) {
+			game->requested	= hint_request(game->hints, &(game->state.board));
+		}
+	}
 
 	glfwSetErrorCallback(error_callback);
 
@@ -78,6 +233,7 @@ main(void) {
 	}
 
 	glfwMakeContextCurrent(window);
+	glfwSetWindowUserPointer(window, game);
 	glfwSetKeyCallback(window, key_callback);
 
 	tex	= image_load_png("boxworld.png");
@@ -94,6 +250,15 @@ main(void) {
 	fnt	= font_bake("DroidSans.ttf", 16, true, true, true, 128 - 32, chars);
 
 	ctx	= renderer_create_context(fnt->atlas->baked_image);
+	if( NULL == ctx || !renderer_add_texture(ctx, tex, &tiles) ) {
+		fprintf(stderr, "unable to create the renderer:\n%s", boxworld_error_string());
+		exit(EXIT_FAILURE);
+	}
+
+	if( bench ) {
+		bench_quads(window, ctx);
+		glfwSetWindowShouldClose(window, GL_TRUE);
+	}
 
 	while (!glfwWindowShouldClose(window)) {
 		int width, height;
@@ -103,11 +268,27 @@ main(void) {
 		glClearColor(0.5f, 0.5f, 0.5f, 0.5f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		renderer_begin(ctx, width, height);
+
+		if( game ) {
+			render_game(ctx, fnt, game);
+			renderer_end(ctx);
+			glfwSwapBuffers(window);
+			glfwPollEvents();
+			continue;
+		}
+
 		renderer_quad(ctx,
 					  vec2(0.0f, 0.0f), vec2(0.0f, 0.0f),
 					  vec2(fnt->atlas->baked_image->width, fnt->atlas->baked_image->height), vec2(1.0f, 1.0f),
 					  color4(1.0f, 1.0f, 1.0f, 1.0f));
 
+		/* the tileset next to it, the text after it still goes with the atlas batch */
+		renderer_set_texture(ctx, tiles);
+		renderer_quad(ctx,
+					  vec2(fnt->atlas->baked_image->width + 16.0f, 0.0f), vec2(0.0f, 0.0f),
+					  vec2(fnt->atlas->baked_image->width + 16.0f + tex->width, tex->height), vec2(1.0f, 1.0f),
+					  color4(1.0f, 1.0f, 1.0f, 1.0f));
+		renderer_set_texture(ctx, 0);
 
 		const uint8* str = (const uint8*)"Hello World!\nThis is a test";
 		font_render_utf8(ctx, fnt, vec2(0.0f, 384.0f), (uint32)strlen((const char*)str), str, color4(1.0f, 1.0f, 1.0f, 1.0f));
@@ -118,6 +299,15 @@ main(void) {
 		glfwPollEvents();
 	}
 
+	if( game ) {
+		if( game->hints ) {
+			hint_worker_release(game->hints);
+		}
+		game_release(&(game->state));
+		level_collection_release(game->coll);
+		free(game);
+	}
+
 	renderer_release(ctx);
 	glfwDestroyWindow(window);
 	glfwTerminate();
@@ -0,0 +1,52 @@
+/*
+** BoxWorld Copyright 2016(c) Wael El Oraiby. All Rights Reserved
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** Under Section 7 of GPL version 3, you are granted additional
+** permissions described in the GCC Runtime Library Exception, version
+** 3.1, as published by the Free Software Foundation.
+**
+** You should have received a copy of the GNU General Public License and
+** a copy of the GCC Runtime Library Exception along with this program;
+** see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+** <http://www.gnu.org/licenses/>.
+**
+*/
+#include "boxworld.h"
+
+/*
+ * converts a text (.xsb/.sok) collection into a compiled level pack
+ */
+int
+main(int argc, char** argv) {
+	level_collection_t*	coll;
+	double				start;
+
+	if( argc != 3 ) {
+		fprintf(stderr, "usage: %s <levels.sok> <levels.bwp>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	start	= boxworld_seconds();
+
+	coll	= level_collection_load(argv[1]);
+	if( NULL == coll ) {
+		fprintf(stderr, "unable to read collection:\n%s\n", boxworld_error_string());
+		return EXIT_FAILURE;
+	}
+
+	if( !levelpack_write(argv[2], coll) ) {
+		fprintf(stderr, "unable to write pack:\n%s\n", boxworld_error_string());
+		level_collection_release(coll);
+		return EXIT_FAILURE;
+	}
+
+	printf("%s: %u levels in %.3f s\n", argv[2], coll->count, boxworld_seconds() - start);
+
+	level_collection_release(coll);
+	return EXIT_SUCCESS;
+}
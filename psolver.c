@@ -0,0 +1,499 @@
+/*
+** BoxWorld Copyright 2016(c) Wael El Oraiby. All Rights Reserved
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** Under Section 7 of GPL version 3, you are granted additional
+** permissions described in the GCC Runtime Library Exception, version
+** 3.1, as published by the Free Software Foundation.
+**
+** You should have received a copy of the GNU General Public License and
+** a copy of the GCC Runtime Library Exception along with this program;
+** see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+** <http://www.gnu.org/licenses/>.
+**
+*/
+#include "boxworld.h"
+#include <pthread.h>
+#include <sched.h>
+
+/*
+ * multi-threaded push search. Every worker owns a deque of nodes: it pushes
+ * and pops at the bottom (depth first, most promising child first) and idle
+ * workers steal from the top of the others, where the shallow nodes with the
+ * biggest subtrees are. All workers share a lock free visited table (64 bit
+ * hashes inserted with compare and swap) and one node arena allocated in
+ * chunks with an atomic counter.
+ *
+ * The first solution found wins, so solutions aren't push optimal.
+ */
+
+enum {
+	NO_NODE			= SOLVER_NO_NODE,
+	NODE_CHUNK		= 64,		/* nodes reserved by a worker at a time */
+	CHECK_INTERVAL	= 256,
+	MAX_THREADS		= 256,
+};
+
+typedef struct {
+	solver_link_t	link;
+	uint64			hash;
+	uint16			player;
+	uint32			h;			/* fits in the padding, sums over large levels don't wrap */
+} pnode_t;
+
+typedef struct {
+	pthread_mutex_t	lock;
+	uint32*			items;
+	uint32			top;		/* thieves take from here */
+	uint32			bottom;		/* the owner pushes and pops here */
+	uint32			max;
+} deque_t;
+
+struct shared_s;
+
+typedef struct {
+	struct shared_s*	sh;
+	uint32				id;
+	pthread_t			thread;
+	deque_t				deque;
+	board_t				board;
+	uint32				node_next;
+	uint32				node_end;
+	uint32				rng;
+	uint64				expanded;
+	uint64				generated;
+	uint64				reach[BOARD_MAX_HEIGHT];
+	uint64				child_reach[BOARD_MAX_HEIGHT];
+} worker_t;
+
+typedef struct shared_s {
+	const board_t*			start;
+	const solver_params_t*	params;
+	double					t0;
+	uint32					box_count;
+	uint16					dist[BOARD_MAX_CELLS];
+
+	pnode_t*				nodes;
+	uint16*					boxes;
+	volatile uint32			node_count;
+	uint32					node_max;
+
+	volatile uint64*		table;		/* 0 is an empty slot */
+	uint32					table_mask;
+
+	worker_t*				workers;
+	uint32					worker_count;
+	uint32					ready;		/* workers with their lock and board set up */
+
+	volatile uint32			pending;	/* nodes queued or being expanded */
+	volatile uint32			found;
+	volatile uint32			stop;		/* SOLVER_RESULT + 1 when the search was stopped */
+} shared_t;
+
+/* true if the hash was not in the table yet */
+static bool
+table_insert(shared_t* sh, uint64 hash) {
+	uint32	i	= (uint32)hash & sh->table_mask;
+
+	hash	|= (hash == 0);
+	for( ;; ) {
+		uint64	cur	= sh->table[i];
+		if( cur == hash ) {
+			return false;
+		}
+		if( 0 == cur ) {
+			cur	= __sync_val_compare_and_swap(&(sh->table[i]), 0, hash);
+			if( 0 == cur ) {
+				return true;
+			}
+			if( cur == hash ) {
+				return false;
+			}
+		}
+		i	= (i + 1) & sh->table_mask;
+	}
+}
+
+static void
+deque_push(deque_t* dq, uint32 node) {
+	pthread_mutex_lock(&(dq->lock));
+	if( dq->bottom == dq->max ) {
+		if( dq->top > 0 ) {
+			memmove(dq->items, dq->items + dq->top, sizeof(uint32) * (dq->bottom - dq->top));
+			dq->bottom	-= dq->top;
+			dq->top		= 0;
+		}
+		if( dq->bottom == dq->max ) {
+			dq->max		= dq->max ? dq->max << 1 : 1024;
+			dq->items	= (uint32*)realloc(dq->items, sizeof(uint32) * dq->max);
+			assert( NULL != dq->items );
+		}
+	}
+	dq->items[dq->bottom++]	= node;
+	pthread_mutex_unlock(&(dq->lock));
+}
+
+static uint32
+deque_pop(deque_t* dq) {
+	uint32	node	= NO_NODE;
+	pthread_mutex_lock(&(dq->lock));
+	if( dq->bottom > dq->top ) {
+		node	= dq->items[--(dq->bottom)];
+	}
+	pthread_mutex_unlock(&(dq->lock));
+	return node;
+}
+
+static uint32
+deque_steal(deque_t* dq) {
+	uint32	node	= NO_NODE;
+	if( pthread_mutex_trylock(&(dq->lock)) != 0 ) {
+		return NO_NODE;
+	}
+	if( dq->bottom > dq->top ) {
+		node	= dq->items[(dq->top)++];
+	}
+	pthread_mutex_unlock(&(dq->lock));
+	return node;
+}
+
+static uint32
+steal(worker_t* w) {
+	shared_t*	sh	= w->sh;
+	uint32		i;
+
+	w->rng	= w->rng * 1103515245u + 12345u;
+	for( i = 0; i < sh->worker_count; ++i ) {
+		uint32	victim	= (w->rng + i) % sh->worker_count;
+		uint32	node;
+		if( victim == w->id ) {
+			continue;
+		}
+		node	= deque_steal(&(sh->workers[victim].deque));
+		if( node != NO_NODE ) {
+			return node;
+		}
+	}
+	return NO_NODE;
+}
+
+static uint32
+alloc_node(worker_t* w) {
+	shared_t*	sh	= w->sh;
+
+	if( w->node_next == w->node_end ) {
+		uint32	base	= __sync_fetch_and_add(&(sh->node_count), NODE_CHUNK);
+		if( base >= sh->node_max ) {
+			return NO_NODE;
+		}
+		w->node_next	= base;
+		w->node_end		= MIN(base + NODE_CHUNK, sh->node_max);
+	}
+	return w->node_next++;
+}
+
+static void
+stop_search(shared_t* sh, SOLVER_RESULT res) {
+	__sync_bool_compare_and_swap(&(sh->stop), 0, (uint32)res + 1);
+}
+
+static void
+expand(worker_t* w, uint32 index) {
+	shared_t*		sh		= w->sh;
+	const pnode_t*	n		= &(sh->nodes[index]);
+	const uint16*	boxes	= sh->boxes + (size_t)index * sh->box_count;
+	uint32			children[BOARD_MAX_CELLS];	/* at most 4 per box */
+	uint32			child_count	= 0;
+	uint32			i, k;
+
+	memset(w->board.boxes, 0, sizeof(uint64) * w->board.height);
+	for( i = 0; i < sh->box_count; ++i ) {
+		board_set(w->board.boxes, boxes[i]);
+	}
+	board_reachable(&(w->board), n->player, w->reach);
+
+	for( i = 0; i < sh->box_count; ++i ) {
+		uint32	box	= boxes[i];
+		uint32	d;
+
+		for( d = KEY_UP; d <= KEY_LEFT; ++d ) {
+			uint32		delta	= board_delta((KEY)d);
+			uint32		to		= box + delta;
+			uint32		player, c;
+			bool		deadlock;
+			uint64		hash;
+			pnode_t*	cn;
+			uint16*		cboxes;
+
+			if( !board_test(w->reach, box - delta) || !board_walkable(&(w->board), to) ||
+				board_test(w->board.boxes, to) || BOARD_DIST_INF == sh->dist[to] ) {
+				continue;
+			}
+
+			board_clear(w->board.boxes, box);
+			board_set(w->board.boxes, to);
+			player	= board_reachable(&(w->board), box, w->child_reach);
+			deadlock	= sh->params->deadlocks && deadlock_check(sh->params->deadlocks, &(w->board), to, w->child_reach) != DEADLOCK_NONE;
+			board_clear(w->board.boxes, to);
+			board_set(w->board.boxes, box);
+
+			++(w->generated);
+			if( deadlock ) {
+				continue;
+			}
+
+			hash	= n->hash ^ zobrist_key(ZOBRIST_PLAYER, n->player) ^ zobrist_key(ZOBRIST_PLAYER, player) ^
+					  zobrist_key(ZOBRIST_BOX, box) ^ zobrist_key(ZOBRIST_BOX, to);
+
+			if( !table_insert(sh, hash) ) {
+				continue;
+			}
+
+			c	= alloc_node(w);
+			if( NO_NODE == c ) {
+				stop_search(sh, SOLVER_OUT_OF_MEMORY);
+				return;
+			}
+
+			cn		= &(sh->nodes[c]);
+			cboxes	= sh->boxes + (size_t)c * sh->box_count;
+
+			solver_move_box(boxes, sh->box_count, i, to, cboxes);
+
+			cn->hash			= hash;
+			cn->player			= (uint16)player;
+			cn->h				= n->h - sh->dist[box] + sh->dist[to];
+			cn->link.parent		= index;
+			cn->link.push_from	= (uint16)box;
+			cn->link.push_dir	= (uint8)d;
+			cn->link.pad		= 0;
+
+			if( 0 == cn->h ) {
+				__sync_bool_compare_and_swap(&(sh->found), NO_NODE, c);
+				return;
+			}
+
+			children[child_count++]	= c;
+		}
+	}
+
+	/* most promising child last, so it's popped first */
+	for( i = 1; i < child_count; ++i ) {
+		uint32	c	= children[i];
+		k	= i;
+		while( k > 0 && sh->nodes[children[k - 1]].h < sh->nodes[c].h ) {
+			children[k]	= children[k - 1];
+			--k;
+		}
+		children[k]	= c;
+	}
+
+	__sync_fetch_and_add(&(sh->pending), child_count);
+	for( i = 0; i < child_count; ++i ) {
+		deque_push(&(w->deque), children[i]);
+	}
+}
+
+static void*
+worker_run(void* arg) {
+	worker_t*		w	= (worker_t*)arg;
+	shared_t*		sh	= w->sh;
+	uint32			idle	= 0;
+
+	while( NO_NODE == sh->found && 0 == sh->stop ) {
+		uint32	node	= deque_pop(&(w->deque));
+
+		if( NO_NODE == node ) {
+			node	= steal(w);
+		}
+
+		if( NO_NODE == node ) {
+			if( 0 == sh->pending ) {
+				break;
+			}
+			if( 0 == (++idle % CHECK_INTERVAL) && sh->params->time_limit > 0.0 &&
+				boxworld_seconds() - sh->t0 > sh->params->time_limit ) {
+				stop_search(sh, SOLVER_TIMEOUT);
+			}
+			sched_yield();
+			continue;
+		}
+
+		expand(w, node);
+		__sync_fetch_and_sub(&(sh->pending), 1);
+		++(w->expanded);
+
+		if( 0 == (w->expanded % CHECK_INTERVAL) ) {
+			if( sh->params->cancel && *(sh->params->cancel) ) {
+				stop_search(sh, SOLVER_CANCELLED);
+			} else if( sh->params->time_limit > 0.0 && boxworld_seconds() - sh->t0 > sh->params->time_limit ) {
+				stop_search(sh, SOLVER_TIMEOUT);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+SOLVER_RESULT
+psolver_solve_board(const board_t* start, const solver_params_t* params, uint32 threads, key_array_t* solution, solver_stats_t* stats) {
+	shared_t*		sh;
+	solver_stats_t	st;
+	size_t			per_node	= sizeof(pnode_t) + sizeof(uint16) * start->box_count;
+	size_t			entries		= 1024;
+	size_t			nodes;
+	uint32			y, i;
+	pnode_t*		root;
+	uint64			hash;
+
+	memset(&st, 0, sizeof(solver_stats_t));
+	threads	= MAX(1, MIN(threads, (uint32)MAX_THREADS));
+
+	sh	= (shared_t*)malloc(sizeof(shared_t));
+	if( NULL == sh ) {
+		st.result	= SOLVER_OUT_OF_MEMORY;
+		goto done;
+	}
+	memset(sh, 0, sizeof(shared_t));
+
+	sh->t0				= boxworld_seconds();
+	sh->start			= start;
+	sh->params			= params;
+	sh->box_count		= start->box_count;
+	sh->found			= NO_NODE;
+	sh->worker_count	= threads;
+
+	/* a quarter of the budget goes to the visited table */
+	while( entries * 2 * sizeof(uint64) <= params->memory_budget / 4 ) {
+		entries	<<= 1;
+	}
+	nodes	= (params->memory_budget - MIN(params->memory_budget, entries * sizeof(uint64))) / per_node;
+	nodes	= MIN(nodes, entries - entries / 4);
+	nodes	= MIN(nodes, (size_t)NO_NODE - NODE_CHUNK * MAX_THREADS);
+
+	sh->table		= (volatile uint64*)calloc(entries, sizeof(uint64));
+	sh->table_mask	= (uint32)entries - 1;
+	sh->nodes		= (pnode_t*)malloc(sizeof(pnode_t) * MAX(nodes, 1));
+	sh->boxes		= (uint16*)malloc(sizeof(uint16) * MAX(sh->box_count, 1) * MAX(nodes, 1));
+	sh->node_max	= (uint32)nodes;
+	sh->workers		= (worker_t*)calloc(threads, sizeof(worker_t));
+
+	if( !sh->table || !sh->nodes || !sh->boxes || !sh->workers || nodes < 1 ) {
+		st.result	= SOLVER_OUT_OF_MEMORY;
+		goto release;
+	}
+
+	board_push_distances(start, sh->dist);
+
+	for( i = 0; i < threads; ++i ) {
+		worker_t*	w	= &(sh->workers[i]);
+		w->sh		= sh;
+		w->id		= i;
+		w->rng		= i * 2654435761u + 1;
+		if( !board_allocate(&(w->board), start->width, start->height) ) {
+			st.result	= SOLVER_OUT_OF_MEMORY;
+			goto release;
+		}
+		board_copy(&(w->board), start);
+		pthread_mutex_init(&(w->deque.lock), NULL);
+		++(sh->ready);
+	}
+
+	/* root */
+	root	= &(sh->nodes[0]);
+	root->h	= solver_root_boxes(start, sh->dist, sh->boxes);
+
+	root->player	= (uint16)board_reachable(&(sh->workers[0].board), start->player, sh->workers[0].reach);
+	hash			= board_boxes_hash(start) ^ zobrist_key(ZOBRIST_PLAYER, root->player);
+	root->hash		= hash;
+	memset(&(root->link), 0, sizeof(solver_link_t));
+	root->link.parent	= NO_NODE;
+	sh->node_count	= NODE_CHUNK;	/* the rest of the first chunk is left unused */
+
+	table_insert(sh, hash);
+
+	if( 0 == root->h ) {
+		sh->found	= 0;
+	} else if( SOLVER_DEAD != root->h ) {
+		sh->pending	= 1;
+		deque_push(&(sh->workers[0].deque), 0);
+
+		/* the calling thread is the first worker, the search goes on with the threads it got */
+		for( i = 1; i < threads; ++i ) {
+			if( 0 != pthread_create(&(sh->workers[i].thread), NULL, worker_run, &(sh->workers[i])) ) {
+				break;
+			}
+		}
+		sh->worker_count	= i;		/* no stealing from workers that never ran */
+		worker_run(&(sh->workers[0]));
+		for( i = 1; i < sh->worker_count; ++i ) {
+			pthread_join(sh->workers[i].thread, NULL);
+		}
+	}
+
+	for( i = 0; i < threads; ++i ) {
+		st.expanded		+= sh->workers[i].expanded;
+		st.generated	+= sh->workers[i].generated;
+	}
+
+	if( sh->found != NO_NODE ) {
+		st.result	= SOLVER_SOLVED;
+		for( y = sh->found; sh->nodes[y].link.parent != NO_NODE; y = sh->nodes[y].link.parent ) {
+			++st.pushes;
+		}
+		if( solution && !solver_build_solution(start, sh->nodes, sizeof(pnode_t), sh->found, solution) ) {
+			st.result	= SOLVER_OUT_OF_MEMORY;
+		}
+	} else if( sh->stop ) {
+		st.result	= (SOLVER_RESULT)(sh->stop - 1);
+	} else {
+		st.result	= SOLVER_UNSOLVABLE;
+	}
+
+	st.memory_used	= sizeof(shared_t) + (size_t)MIN(sh->node_count, sh->node_max) * (per_node + sizeof(uint64));
+
+release:
+	if( sh->workers ) {
+		for( i = 0; i < threads; ++i ) {
+			board_release(&(sh->workers[i].board));
+			free(sh->workers[i].deque.items);
+			if( i < sh->ready ) {
+				pthread_mutex_destroy(&(sh->workers[i].deque.lock));
+			}
+		}
+	}
+	free(sh->workers);
+	free((void*)sh->table);
+	free(sh->nodes);
+	free(sh->boxes);
+	st.elapsed	= boxworld_seconds() - sh->t0;
+	free(sh);
+
+done:
+	if( stats ) {
+		*stats	= st;
+	}
+	return st.result;
+}
+
+SOLVER_RESULT
+psolver_solve(const level_t* lvl, const solver_params_t* params, uint32 threads, key_array_t* solution, solver_stats_t* stats) {
+	board_t			b;
+	SOLVER_RESULT	res;
+
+	if( !board_from_level(&b, lvl) ) {
+		if( stats ) {
+			memset(stats, 0, sizeof(solver_stats_t));
+			stats->result	= SOLVER_INVALID;
+		}
+		return SOLVER_INVALID;
+	}
+
+	res	= psolver_solve_board(&b, params, threads, solution, stats);
+	board_release(&b);
+	return res;
+}
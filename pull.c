@@ -0,0 +1,301 @@
+/*
+** BoxWorld Copyright 2016(c) Wael El Oraiby. All Rights Reserved
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** Under Section 7 of GPL version 3, you are granted additional
+** permissions described in the GCC Runtime Library Exception, version
+** 3.1, as published by the Free Software Foundation.
+**
+** You should have received a copy of the GNU General Public License and
+** a copy of the GCC Runtime Library Exception along with this program;
+** see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+** <http://www.gnu.org/licenses/>.
+**
+*/
+#include "boxworld.h"
+
+/*
+ * reverse play: boxes are pulled instead of pushed. A position can be solved
+ * exactly when it can be pulled to from a solved one, so a breadth first pull
+ * search from every goal configuration answers it without exploring forward.
+ * States are the sorted box squares plus the normalized player square,
+ * identified by the same zobrist hash as the solver. Storage is allocated
+ * once from the state budget, the search only rebuilds the boxes plane of a
+ * scratch board for each state.
+ */
+
+uint32
+board_pull(board_t* b, KEY dir, bool pull) {
+	uint32	delta	= board_delta(dir);
+	uint32	to		= b->player + delta;
+	uint32	box		= b->player - delta;
+
+	if( !board_walkable(b, to) || board_test(b->boxes, to) ) {
+		return MOVE_NONE;
+	}
+
+	pull	= pull && board_walkable(b, box) && board_test(b->boxes, box);
+	if( pull ) {
+		board_clear(b->boxes, box);
+		board_set(b->boxes, b->player);
+		b->boxes_on_goal	+= (uint32)board_test(b->goals, b->player) - (uint32)board_test(b->goals, box);
+	}
+
+	b->player	= to;
+	return pull ? MOVE_WALK | MOVE_PULL : MOVE_WALK;
+}
+
+uint32
+board_goal_regions(const board_t* b, uint32* regions, uint32 max) {
+	board_t		g;
+	uint64		seen[BOARD_MAX_HEIGHT];
+	uint64		reach[BOARD_MAX_HEIGHT];
+	uint32		count	= 0;
+	uint32		y;
+
+	if( !board_allocate(&g, b->width, b->height) ) {
+		return 0;
+	}
+
+	board_copy(&g, b);
+	for( y = 0; y < b->height; ++y ) {
+		g.boxes[y]	= b->goals[y];
+		seen[y]		= b->floor[y] & ~b->goals[y];
+	}
+
+	/* every flood clears a region from the unseen squares */
+	for( y = 0; y < b->height; ++y ) {
+		while( seen[y] ) {
+			uint32	pos	= board_pos((uint32)__builtin_ctzll(seen[y]), y);
+			uint32	r;
+
+			board_reachable(&g, pos, reach);
+			for( r = y; r < b->height; ++r ) {
+				seen[r]	&= ~reach[r];
+			}
+
+			if( count < max ) {
+				regions[count]	= pos;		/* the first unseen square is the smallest of its region */
+			}
+			++count;
+		}
+	}
+
+	board_release(&g);
+	return count;
+}
+
+typedef struct {
+	board_t		board;		/* scratch board, the boxes plane is rebuilt for every state */
+	uint32		box_count;
+	uint16*		boxes;		/* box_count sorted squares per state */
+	uint16*		player;		/* normalized player square per state */
+	uint32		count;
+	uint32		max;
+	uint64*		table;		/* state hashes, 0 is an empty slot */
+	uint32		table_mask;
+	uint64		reach[BOARD_MAX_HEIGHT];
+} pull_search_t;
+
+static void
+load_boxes(pull_search_t* s, uint32 state) {
+	const uint16*	boxes	= s->boxes + (size_t)state * s->box_count;
+	uint32			i;
+
+	memset(s->board.boxes, 0, sizeof(uint64) * s->board.height);
+	for( i = 0; i < s->box_count; ++i ) {
+		board_set(s->board.boxes, boxes[i]);
+	}
+}
+
+/* false when the hash was already there */
+static bool
+table_insert(pull_search_t* s, uint64 hash) {
+	uint32	i	= (uint32)hash & s->table_mask;
+
+	hash	= hash ? hash : 1;
+	for( ;; ) {
+		if( 0 == s->table[i] ) {
+			s->table[i]	= hash;
+			return true;
+		}
+		if( s->table[i] == hash ) {
+			return false;
+		}
+		i	= (i + 1) & s->table_mask;
+	}
+}
+
+/* appends a child of parent where the box at 'from' moved to 'to', keeping the squares sorted */
+static void
+add_state(pull_search_t* s, const uint16* parent, uint32 from, uint32 to, uint32 player) {
+	uint16*	boxes	= s->boxes + (size_t)s->count * s->box_count;
+	uint32	i, j;
+
+	for( i = 0, j = 0; i < s->box_count; ++i ) {
+		if( parent[i] != from ) {
+			boxes[j++]	= parent[i];
+		}
+	}
+
+	for( i = j; i > 0 && boxes[i - 1] > to; --i ) {
+		boxes[i]	= boxes[i - 1];
+	}
+	boxes[i]	= (uint16)to;
+
+	s->player[s->count++]	= (uint16)player;
+}
+
+static uint64
+state_hash(const board_t* b, uint32 player) {
+	return board_boxes_hash(b) ^ zobrist_key(ZOBRIST_PLAYER, player);
+}
+
+PULL_RESULT
+pull_search(const board_t* b, uint32 max_states, pull_stats_t* stats) {
+	pull_search_t*	s;
+	uint64			target;
+	uint32			regions[BOARD_MAX_CELLS / 2];
+	uint32			region_count;
+	uint32			entries	= 1024;
+	uint32			head	= 0;
+	uint32			y, i, r;
+	PULL_RESULT		res		= PULL_UNSOLVABLE;
+
+	if( stats ) {
+		memset(stats, 0, sizeof(pull_stats_t));
+	}
+
+	s	= (pull_search_t*)calloc(1, sizeof(pull_search_t));
+	if( NULL == s || !board_allocate(&(s->board), b->width, b->height) ) {
+		free(s);
+		return PULL_UNKNOWN;
+	}
+	board_copy(&(s->board), b);
+
+	max_states	= MAX(max_states, 1);
+	while( entries < max_states * 2 && entries < 0x80000000u ) {
+		entries	<<= 1;
+	}
+
+	s->box_count	= b->box_count;
+	s->max			= max_states;
+	s->table_mask	= entries - 1;
+	s->table		= (uint64*)calloc(entries, sizeof(uint64));
+	s->boxes		= (uint16*)malloc(sizeof(uint16) * MAX(s->box_count, 1) * (size_t)max_states);
+	s->player		= (uint16*)malloc(sizeof(uint16) * (size_t)max_states);
+	if( NULL == s->table || NULL == s->boxes || NULL == s->player ) {
+		res	= PULL_UNKNOWN;
+		goto done;
+	}
+
+	target	= state_hash(b, board_reachable(b, b->player, s->reach));
+
+	/* the goal configurations: boxes on every goal, one state per player region */
+	region_count	= board_goal_regions(b, regions, sizeof(regions) / sizeof(uint32));
+	for( y = 0; y < b->height; ++y ) {
+		s->board.boxes[y]	= b->goals[y];
+	}
+
+	for( r = 0; r < region_count && s->count < s->max; ++r ) {
+		uint64	hash	= state_hash(&(s->board), regions[r]);
+		uint16*	boxes	= s->boxes + (size_t)s->count * s->box_count;
+
+		if( !table_insert(s, hash) ) {
+			continue;
+		}
+
+		for( y = 0, i = 0; y < b->height; ++y ) {
+			uint64	row	= b->goals[y];
+			while( row ) {
+				boxes[i++]	= (uint16)board_pos((uint32)__builtin_ctzll(row), y);
+				row	&= row - 1;
+			}
+		}
+		s->player[s->count++]	= (uint16)regions[r];
+
+		if( hash == target ) {
+			res	= PULL_SOLVABLE;
+			goto done;
+		}
+	}
+
+	/* the state array is the breadth first queue */
+	for( ; head < s->count; ++head ) {
+		const uint16*	boxes	= s->boxes + (size_t)head * s->box_count;
+		uint64			box_hash;
+
+		load_boxes(s, head);
+		box_hash	= board_boxes_hash(&(s->board));
+		board_reachable(&(s->board), s->player[head], s->reach);
+
+		for( i = 0; i < s->box_count; ++i ) {
+			uint32	box	= boxes[i];
+			uint32	d;
+
+			/* the player stands next to the box and backs away, dragging it */
+			for( d = KEY_UP; d <= KEY_LEFT; ++d ) {
+				uint32	delta	= board_delta((KEY)d);
+				uint32	to		= box + delta;
+				uint32	player	= to + delta;
+				uint32	norm;
+				uint64	hash;
+				uint64	reach[BOARD_MAX_HEIGHT];
+
+				if( !board_walkable(&(s->board), to) || !board_test(s->reach, to) ||
+					!board_walkable(&(s->board), player) || board_test(s->board.boxes, player) ) {
+					continue;
+				}
+
+				board_clear(s->board.boxes, box);
+				board_set(s->board.boxes, to);
+				norm	= board_reachable(&(s->board), player, reach);
+				hash	= box_hash ^ zobrist_key(ZOBRIST_BOX, box) ^ zobrist_key(ZOBRIST_BOX, to) ^ zobrist_key(ZOBRIST_PLAYER, norm);
+
+				if( table_insert(s, hash) ) {
+					if( s->count == s->max ) {
+						res	= PULL_UNKNOWN;
+						goto done;
+					}
+
+					add_state(s, boxes, box, to, norm);
+					if( hash == target ) {
+						res	= PULL_SOLVABLE;
+						goto done;
+					}
+				}
+
+				board_clear(s->board.boxes, to);
+				board_set(s->board.boxes, box);
+			}
+		}
+	}
+
+done:
+	if( stats ) {
+		stats->result	= res;
+		stats->states	= s->count;
+		stats->expanded	= head;
+	}
+
+	free(s->table);
+	free(s->boxes);
+	free(s->player);
+	board_release(&(s->board));
+	free(s);
+	return res;
+}
+
+const char*
+pull_result_string(PULL_RESULT res) {
+	switch( res ) {
+	case PULL_SOLVABLE		: return "solvable";
+	case PULL_UNSOLVABLE	: return "unsolvable";
+	case PULL_UNKNOWN		: return "unknown";
+	}
+	return "unknown";
+}
@@ -18,36 +18,25 @@
 */
 #include "boxworld.h"
 
-gfx_context_t*
-renderer_create_context(const image_t* tex) {
-	GL_ENUM			pf;
-	gfx_context_t*	ctx	= (gfx_context_t*)malloc(sizeof(gfx_context_t));
-	char			infoLog[2048]	= {0};
-	int				infoLen			= 0;
-
-	if( NULL == ctx ) {
-		return (gfx_context_t*)boxworld_error(NOT_ENOUGH_MEMORY, "renderer_create_context: not enough memory");
-	}
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
 
-	memset(ctx, 0, sizeof(gfx_context_t));
-
-	glGenTextures(1, &(ctx->texture));
-	glBindTexture(GL_TEXTURE_2D, ctx->texture);
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+#ifndef APIENTRY
+#	define APIENTRY
+#endif
 
-	switch(tex->format) {
-	case PF_A8		: pf	= GL_ALPHA; break;
-	case PF_R8G8B8	: pf	= GL_RGB;	break;
-	case PF_R8G8B8A8: pf	= GL_RGBA;	break;
-	}
-
-	glTexImage2D(GL_TEXTURE_2D, 0, pf, tex->width, tex->height, 0, pf, GL_UNSIGNED_BYTE, tex->pixels);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+/*
+ * the instanced path needs glVertexAttribDivisor and glDrawElementsInstanced,
+ * which emuGLES2 doesn't declare: they are looked up once a context reports
+ * GL 3.3 or GLES 3.0
+ */
+typedef void (APIENTRY* vertex_attrib_divisor_fn)(GLuint index, GLuint divisor);
+typedef void (APIENTRY* draw_elements_instanced_fn)(GL_ENUM mode, GLint count, GL_ENUM type, const void* indices, GLint instances);
 
-	ctx->program = glCreateProgram();
+static vertex_attrib_divisor_fn		vertex_attrib_divisor;
+static draw_elements_instanced_fn	draw_elements_instanced;
 
-	const char * vs =
+static const char*	quad_vs	=
 			"#version 120\n"
 			"uniform highp vec2 Viewport;\n"
 			"attribute highp vec2 VertexPosition;\n"
@@ -62,14 +51,27 @@ renderer_create_context(const image_t* tex) {
 			"    highp vec2 pos = vec2(VertexPosition.x, Viewport.y - VertexPosition.y) * 2.0 / Viewport - 1.0;\n"
 			"    gl_Position = vec4(pos, 0.0, 1.0);\n"
 			"}\n";
-	GLuint vso = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vso, 1, (const char **)  &vs, NULL);
-	glCompileShader(vso);
-	glGetShaderInfoLog(vso, 2048, &infoLen, infoLog);
-	printf("vs shader log: %s\n", infoLog);
-	glAttachShader(ctx->program, vso);
 
-	const char * fs =
+/* a unit quad corner stretched over the rectangles of the instance */
+static const char*	instance_vs	=
+			"#version 120\n"
+			"uniform highp vec2 Viewport;\n"
+			"attribute highp vec2 Corner;\n"
+			"attribute highp vec4 InstanceRect;\n"
+			"attribute highp vec4 InstanceTexRect;\n"
+			"attribute highp vec4 InstanceColor;\n"
+			"varying highp vec2 texCoord;\n"
+			"varying highp vec4 vertexColor;\n"
+			"void main()\n"
+			"{\n"
+			"    vertexColor = InstanceColor;\n"
+			"    texCoord = mix(InstanceTexRect.xy, InstanceTexRect.zw, Corner);\n"
+			"    highp vec2 p = mix(InstanceRect.xy, InstanceRect.zw, Corner);\n"
+			"    highp vec2 pos = vec2(p.x, Viewport.y - p.y) * 2.0 / Viewport - 1.0;\n"
+			"    gl_Position = vec4(pos, 0.0, 1.0);\n"
+			"}\n";
+
+static const char*	quad_fs	=
 			"#version 120\n"
 			"varying highp vec2 texCoord;\n"
 			"varying highp vec4 vertexColor;\n"
@@ -78,20 +80,151 @@ renderer_create_context(const image_t* tex) {
 			"{\n"
 			"    gl_FragColor = texture2D(Texture, texCoord) * vertexColor;\n"
 			"}\n";
-	GLuint fso = glCreateShader(GL_FRAGMENT_SHADER);
+
+/* first_attribute gets location 0, which some drivers want to be per vertex */
+static GLuint
+link_program(const char* vs, const char* fs, const char* first_attribute) {
+	GLuint	program	= glCreateProgram();
+	GLuint	vso		= glCreateShader(GL_VERTEX_SHADER);
+	GLuint	fso		= glCreateShader(GL_FRAGMENT_SHADER);
+	char	infoLog[2048]	= {0};
+	int		infoLen			= 0;
+
+	glShaderSource(vso, 1, (const char **)  &vs, NULL);
+	glCompileShader(vso);
+	glGetShaderInfoLog(vso, 2048, &infoLen, infoLog);
+	printf("vs shader log: %s\n", infoLog);
+	glAttachShader(program, vso);
 
 	glShaderSource(fso, 1, (const char **) &fs, NULL);
 	glCompileShader(fso);
 	glGetShaderInfoLog(fso, 2048, &infoLen, infoLog);
 	printf("fs shader log: %s\n", infoLog);
-	glAttachShader(ctx->program, fso);
+	glAttachShader(program, fso);
 
-	glLinkProgram(ctx->program);
-	glGetProgramInfoLog(ctx->program, 2048, &infoLen, infoLog);
+	glBindAttribLocation(program, 0, first_attribute);
+	glLinkProgram(program);
+	glGetProgramInfoLog(program, 2048, &infoLen, infoLog);
 	printf("programr log: %s\n", infoLog);
 	glDeleteShader(vso);
 	glDeleteShader(fso);
 
+	return program;
+}
+
+/*
+ * core entry points only: a 2.1 context with the ARB extensions would need
+ * the ...ARB names. ES contexts report "OpenGL ES 3.0 ..."
+ */
+static bool
+instancing_supported() {
+	static const char	es_prefix[]	= "OpenGL ES ";
+	const char*			version		= (const char*)glGetString(GL_VERSION);
+	int					major		= 0, minor	= 0;
+	bool				es;
+
+	if( NULL == version ) {
+		return false;
+	}
+
+	es	= 0 == strncmp(version, es_prefix, sizeof(es_prefix) - 1);
+	if( es ) {
+		version	+= sizeof(es_prefix) - 1;
+	}
+
+	if( 2 != sscanf(version, "%d.%d", &major, &minor) ) {
+		return false;
+	}
+	return es ? major >= 3 : (major > 3 || (3 == major && minor >= 3));
+}
+
+static void
+create_instanced(gfx_context_t* ctx) {
+	static const float	corners[]	= { 0.0f, 0.0f,  1.0f, 0.0f,  1.0f, 1.0f,  0.0f, 1.0f };
+	GLint				linked	= GL_FALSE;
+
+	if( !instancing_supported() ) {
+		return;
+	}
+
+	vertex_attrib_divisor	= (vertex_attrib_divisor_fn)glfwGetProcAddress("glVertexAttribDivisor");
+	draw_elements_instanced	= (draw_elements_instanced_fn)glfwGetProcAddress("glDrawElementsInstanced");
+	if( NULL == vertex_attrib_divisor || NULL == draw_elements_instanced ) {
+		return;
+	}
+
+	ctx->instProgram	= link_program(instance_vs, quad_fs, "Corner");
+	glGetProgramiv(ctx->instProgram, GL_LINK_STATUS, &linked);
+	if( GL_TRUE != linked ) {
+		glDeleteProgram(ctx->instProgram);
+		ctx->instProgram	= 0;
+		return;
+	}
+
+	ctx->uniInstViewport	= glGetUniformLocation(ctx->instProgram, "Viewport");
+	ctx->uniInstTexture		= glGetUniformLocation(ctx->instProgram, "Texture");
+
+	ctx->attrCorner			= glGetAttribLocation(ctx->instProgram, "Corner");
+	ctx->attrRect			= glGetAttribLocation(ctx->instProgram, "InstanceRect");
+	ctx->attrTexRect		= glGetAttribLocation(ctx->instProgram, "InstanceTexRect");
+	ctx->attrInstColor		= glGetAttribLocation(ctx->instProgram, "InstanceColor");
+
+	glGenBuffers(1, &(ctx->cornerVbo));
+	glBindBuffer(GL_ARRAY_BUFFER, ctx->cornerVbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	ctx->instanced	= true;
+}
+
+bool
+renderer_add_texture(gfx_context_t* ctx, const image_t* img, uint32* id) {
+	GL_ENUM		pf	= GL_RGBA;
+	GLuint		texture;
+
+	if( MAX_TEXTURES == ctx->numTextures ) {
+		boxworld_error(UNSUPPORTED, "renderer_add_texture: too many textures");
+		return false;
+	}
+
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	switch(img->format) {
+	case PF_A8		: pf	= GL_ALPHA; break;
+	case PF_R8G8B8	: pf	= GL_RGB;	break;
+	case PF_R8G8B8A8: pf	= GL_RGBA;	break;
+	}
+
+	glTexImage2D(GL_TEXTURE_2D, 0, pf, img->width, img->height, 0, pf, GL_UNSIGNED_BYTE, img->pixels);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	ctx->textures[ctx->numTextures]	= texture;
+	*id	= ctx->numTextures++;
+	return true;
+}
+
+gfx_context_t*
+renderer_create_context(const image_t* tex) {
+	gfx_context_t*	ctx	= (gfx_context_t*)malloc(sizeof(gfx_context_t));
+	GLushort*		indices;
+	uint32			q;
+
+	if( NULL == ctx ) {
+		return (gfx_context_t*)boxworld_error(NOT_ENOUGH_MEMORY, "renderer_create_context: not enough memory");
+	}
+
+	memset(ctx, 0, sizeof(gfx_context_t));
+	ctx->sprites	= render_sprite_array_new();
+
+	/* texture 0, the one quads use unless told otherwise */
+	renderer_add_texture(ctx, tex, &q);
+
+	ctx->program	= link_program(quad_vs, quad_fs, "VertexPosition");
+
 	glUseProgram(ctx->program);
 	ctx->uniViewport	= glGetUniformLocation(ctx->program, "Viewport");
 	ctx->uniTexture		= glGetUniformLocation(ctx->program, "Texture");
@@ -102,41 +235,100 @@ renderer_create_context(const image_t* tex) {
 
 	glUseProgram(0);
 
+	/* storage comes with the first flush */
 	glGenBuffers(1, &(ctx->vbo));
 
-	glBindBuffer(GL_ARRAY_BUFFER, ctx->vbo);
-	glBufferData(GL_ARRAY_BUFFER, MAX_QUADS * sizeof(render_quad_t), ctx->quads, GL_DYNAMIC_DRAW);
+	/* every quad is the same two triangles over its 4 corners, uploaded once */
+	indices	= (GLushort*)malloc(MAX_QUADS * 6 * sizeof(GLushort));
+	if( NULL == indices ) {
+		renderer_release(ctx);
+		free(ctx);
+		return (gfx_context_t*)boxworld_error(NOT_ENOUGH_MEMORY, "renderer_create_context: not enough memory");
+	}
+
+	for( q = 0; q < MAX_QUADS; ++q ) {
+		indices[q * 6 + 0]	= (GLushort)(q * 4 + 0);
+		indices[q * 6 + 1]	= (GLushort)(q * 4 + 1);
+		indices[q * 6 + 2]	= (GLushort)(q * 4 + 2);
+		indices[q * 6 + 3]	= (GLushort)(q * 4 + 0);
+		indices[q * 6 + 4]	= (GLushort)(q * 4 + 2);
+		indices[q * 6 + 5]	= (GLushort)(q * 4 + 3);
+	}
+
+	glGenBuffers(1, &(ctx->ibo));
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ctx->ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, MAX_QUADS * 6 * sizeof(GLushort), indices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	free(indices);
+
+	create_instanced(ctx);
 
 	return ctx;
 }
 
 void
 renderer_release(gfx_context_t* ctx) {
-	if( ctx->texture ) {
-		glDeleteTextures(1, &(ctx->texture));
-		ctx->texture = 0;
+	if( ctx->numTextures ) {
+		glDeleteTextures(ctx->numTextures, ctx->textures);
+		ctx->numTextures	= 0;
 	}
 
+	render_sprite_array_release(&(ctx->sprites));
+
 	if( ctx->vbo ) {
 		glDeleteBuffers(1, &(ctx->vbo));
 		ctx->vbo	= 0;
 	}
 
+	if( ctx->ibo ) {
+		glDeleteBuffers(1, &(ctx->ibo));
+		ctx->ibo	= 0;
+	}
+
 	if( ctx->program ) {
 		glDeleteProgram(ctx->program);
 		ctx->program = 0;
 	}
 
+	if( ctx->cornerVbo ) {
+		glDeleteBuffers(1, &(ctx->cornerVbo));
+		ctx->cornerVbo	= 0;
+	}
+
+	if( ctx->instProgram ) {
+		glDeleteProgram(ctx->instProgram);
+		ctx->instProgram	= 0;
+	}
+
+	ctx->instanced	= false;
+}
+
+/* between frames only, false when the instanced path isn't there */
+bool
+renderer_set_instanced(gfx_context_t* ctx, bool instanced) {
+	ctx->instanced	= instanced && 0 != ctx->instProgram;
+	return ctx->instanced;
+}
+
+void
+renderer_set_texture(gfx_context_t* ctx, uint32 id) {
+	assert( id < ctx->numTextures );
+	ctx->currentTexture	= id;
+}
+
+/* higher layers are drawn over lower ones, within a layer textures may reorder */
+void
+renderer_set_layer(gfx_context_t* ctx, uint32 layer) {
+	ctx->currentLayer	= layer;
 }
 
 void
 renderer_begin(gfx_context_t* ctx, int width, int height) {
 	glViewport(0, 0, width, height);
-	glUseProgram(ctx->program);
+	glUseProgram(ctx->instanced ? ctx->instProgram : ctx->program);
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, ctx->texture);
-	glUniform2f(ctx->uniViewport, (float) width, (float) height);
-	glUniform1i(ctx->uniTexture, 0);
+	glUniform2f(ctx->instanced ? ctx->uniInstViewport : ctx->uniViewport, (float) width, (float) height);
+	glUniform1i(ctx->instanced ? ctx->uniInstTexture : ctx->uniTexture, 0);
 
 	glEnable(GL_BLEND);
 	glDisable(GL_DEPTH_TEST);
@@ -144,84 +336,189 @@ renderer_begin(gfx_context_t* ctx, int width, int height) {
 	glDisable(GL_CULL_FACE);
 
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-}
 
-static void
-flush(gfx_context_t* ctx) {
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ctx->ibo);
+
+	ctx->sprites.count	= 0;
+	ctx->currentTexture	= 0;
+	ctx->currentLayer	= 0;
+	ctx->drawCalls		= 0;
+
+	if( ctx->instanced ) {
+		glEnableVertexAttribArray(ctx->attrCorner);
+		glEnableVertexAttribArray(ctx->attrRect);
+		glEnableVertexAttribArray(ctx->attrTexRect);
+		glEnableVertexAttribArray(ctx->attrInstColor);
+
+		glBindBuffer(GL_ARRAY_BUFFER, ctx->cornerVbo);
+		glVertexAttribPointer(ctx->attrCorner, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+
+		vertex_attrib_divisor(ctx->attrRect, 1);
+		vertex_attrib_divisor(ctx->attrTexRect, 1);
+		vertex_attrib_divisor(ctx->attrInstColor, 1);
+		return;
+	}
+
 	glEnableVertexAttribArray(ctx->attrPosition);
 	glEnableVertexAttribArray(ctx->attrTexCoord);
 	glEnableVertexAttribArray(ctx->attrColor);
+}
+
+/*
+ * the batch re-specifies the whole buffer with just the bytes it uses. That
+ * orphans the storage the previous draw still reads from: the driver hands
+ * back fresh storage instead of waiting for that draw to finish.
+ */
+static void
+flush(gfx_context_t* ctx) {
+	if( 0 == ctx->numQuads ) {
+		return;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, ctx->textures[ctx->batchTexture]);
+	++(ctx->drawCalls);
 
-	/* TODO: this is highly inefficient */
 	glBindBuffer(GL_ARRAY_BUFFER, ctx->vbo);
 
-	/* is this needed ? */
-	glBufferSubData(GL_ARRAY_BUFFER, 0, ctx->numQuads * sizeof(render_quad_t), ctx->quads);
+	if( ctx->instanced ) {
+		glBufferData(GL_ARRAY_BUFFER, ctx->numQuads * sizeof(render_instance_t), ctx->instances, GL_STREAM_DRAW);
+
+		glVertexAttribPointer(ctx->attrRect,      4, GL_FLOAT,          GL_FALSE, sizeof(render_instance_t), (void*)offsetof(render_instance_t, start));
+		glVertexAttribPointer(ctx->attrTexRect,   4, GL_UNSIGNED_SHORT, GL_TRUE,  sizeof(render_instance_t), (void*)offsetof(render_instance_t, tex));
+		glVertexAttribPointer(ctx->attrInstColor, 4, GL_UNSIGNED_BYTE,  GL_TRUE,  sizeof(render_instance_t), (void*)offsetof(render_instance_t, color));
+
+		draw_elements_instanced(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, (void*)0, ctx->numQuads);
+
+		ctx->numQuads	= 0;
+		return;
+	}
 
-	glVertexAttribPointer(ctx->attrPosition, 2, GL_FLOAT, GL_FALSE, sizeof(render_vertex_t), (void*)0);
-	glVertexAttribPointer(ctx->attrTexCoord, 2, GL_FLOAT, GL_FALSE, sizeof(render_vertex_t), (void*)sizeof(vec2_t));
-	glVertexAttribPointer(ctx->attrColor,    4, GL_FLOAT, GL_FALSE, sizeof(render_vertex_t), (void*)(sizeof(vec2_t) + sizeof(vec2_t)));
+	glBufferData(GL_ARRAY_BUFFER, ctx->numQuads * sizeof(render_quad_t), ctx->quads, GL_STREAM_DRAW);
 
-	glDrawArrays(GL_TRIANGLES, 0, 6 * ctx->numQuads);
+	glVertexAttribPointer(ctx->attrPosition, 2, GL_FLOAT,          GL_FALSE, sizeof(render_vertex_t), (void*)offsetof(render_vertex_t, position));
+	glVertexAttribPointer(ctx->attrTexCoord, 2, GL_UNSIGNED_SHORT, GL_TRUE,  sizeof(render_vertex_t), (void*)offsetof(render_vertex_t, tex));
+	glVertexAttribPointer(ctx->attrColor,    4, GL_UNSIGNED_BYTE,  GL_TRUE,  sizeof(render_vertex_t), (void*)offsetof(render_vertex_t, color));
 
-	glDisableVertexAttribArray(ctx->attrPosition);
-	glDisableVertexAttribArray(ctx->attrTexCoord);
-	glDisableVertexAttribArray(ctx->attrColor);
+	glDrawElements(GL_TRIANGLES, 6 * ctx->numQuads, GL_UNSIGNED_SHORT, (void*)0);
 
 	ctx->numQuads	= 0;
 }
 
+/* [0, 1] to the full integer range, read back as floats by the normalized attributes */
+static INLINE uint16
+unorm16(float f) {
+	return (uint16)(MAX(0.0f, MIN(f, 1.0f)) * 65535.0f + 0.5f);
+}
+
+static INLINE uint8
+unorm8(float f) {
+	return (uint8)(MAX(0.0f, MIN(f, 1.0f)) * 255.0f + 0.5f);
+}
+
 void
 renderer_quad(gfx_context_t* ctx, vec2_t sv, vec2_t st, vec2_t ev, vec2_t et, color4_t col) {
-	vec2_t		v0, v1, v2, v3;
-	vec2_t		t0, t1, t2, t3;
-
-	float		x0 = sv.x, y0 = sv.y, x1 = ev.x, y1 = ev.y;
-	float		tu0 = st.x, tv0 = st.y, tu1 = et.x, tv1 = et.y;
+	render_sprite_t	s;
+
+	s.quad.start	= sv;
+	s.quad.end		= ev;
+	s.quad.tex[0]	= unorm16(st.x);
+	s.quad.tex[1]	= unorm16(st.y);
+	s.quad.tex[2]	= unorm16(et.x);
+	s.quad.tex[3]	= unorm16(et.y);
+	s.quad.color	= color4b(unorm8(col.r), unorm8(col.g), unorm8(col.b), unorm8(col.a));
+	s.key			= ctx->currentLayer * MAX_TEXTURES + ctx->currentTexture;
+	s.order			= (uint32)ctx->sprites.count;
+
+	render_sprite_array_push(&(ctx->sprites), s);
+}
 
-	if( ctx->numQuads + 1 > MAX_QUADS ) {
-		/* flush */
-		flush(ctx);
-	}
+static void
+expand_quad(render_vertex_t* q, const render_instance_t* i) {
+	q[0].position	= i->start;
+	q[1].position	= vec2(i->end.x, i->start.y);
+	q[2].position	= i->end;
+	q[3].position	= vec2(i->start.x, i->end.y);
+
+	q[0].tex[0]	= i->tex[0];	q[0].tex[1]	= i->tex[1];
+	q[1].tex[0]	= i->tex[2];	q[1].tex[1]	= i->tex[1];
+	q[2].tex[0]	= i->tex[2];	q[2].tex[1]	= i->tex[3];
+	q[3].tex[0]	= i->tex[0];	q[3].tex[1]	= i->tex[3];
+
+	q[0].color		= i->color;
+	q[1].color		= i->color;
+	q[2].color		= i->color;
+	q[3].color		= i->color;
+}
 
+static int
+compare_sprites(const void* a, const void* b) {
+	const render_sprite_t*	sa	= (const render_sprite_t*)a;
+	const render_sprite_t*	sb	= (const render_sprite_t*)b;
 
-	v0	= vec2(x0, y0);
-	v1	= vec2(x1, y0);
-	v2	= vec2(x1, y1);
-	v3	= vec2(x0, y1);
+	if( sa->key != sb->key ) {
+		return sa->key < sb->key ? -1 : 1;
+	}
+	return sa->order < sb->order ? -1 : (sa->order > sb->order);
+}
 
-	t0	= vec2(tu0, tv0);
-	t1	= vec2(tu1, tv0);
-	t2	= vec2(tu1, tv1);
-	t3	= vec2(tu0, tv1);
+/*
+ * the frame draw list, sorted by layer then texture with submission order
+ * kept inside a run. A batch is cut when the texture changes or it is full,
+ * so runs of a texture merge even across layers.
+ */
+static void
+draw_sprites(gfx_context_t* ctx) {
+	render_sprite_t*	s	= ctx->sprites.array;
+	size_t				n	= ctx->sprites.count;
+	size_t				i;
+
+	/* a frame with a single texture per layer is already in order */
+	for( i = 1; i < n && s[i - 1].key <= s[i].key; ++i ) {}
+	if( i < n ) {
+		qsort(s, n, sizeof(render_sprite_t), compare_sprites);
+	}
 
-	ctx->quads[ctx->numQuads][0].position	= v0;
-	ctx->quads[ctx->numQuads][1].position	= v1;
-	ctx->quads[ctx->numQuads][2].position	= v2;
-	ctx->quads[ctx->numQuads][3].position	= v0;
-	ctx->quads[ctx->numQuads][4].position	= v2;
-	ctx->quads[ctx->numQuads][5].position	= v3;
+	for( i = 0; i < n; ++i ) {
+		uint32	texture	= s[i].key % MAX_TEXTURES;
 
-	ctx->quads[ctx->numQuads][0].tex		= t0;
-	ctx->quads[ctx->numQuads][1].tex		= t1;
-	ctx->quads[ctx->numQuads][2].tex		= t2;
-	ctx->quads[ctx->numQuads][3].tex		= t0;
-	ctx->quads[ctx->numQuads][4].tex		= t2;
-	ctx->quads[ctx->numQuads][5].tex		= t3;
+		if( MAX_QUADS == ctx->numQuads || (ctx->numQuads && texture != ctx->batchTexture) ) {
+			flush(ctx);
+		}
+		ctx->batchTexture	= texture;
 
-	ctx->quads[ctx->numQuads][0].color		= col;
-	ctx->quads[ctx->numQuads][1].color		= col;
-	ctx->quads[ctx->numQuads][2].color		= col;
-	ctx->quads[ctx->numQuads][3].color		= col;
-	ctx->quads[ctx->numQuads][4].color		= col;
-	ctx->quads[ctx->numQuads][5].color		= col;
+		if( ctx->instanced ) {
+			ctx->instances[ctx->numQuads++]	= s[i].quad;
+		} else {
+			expand_quad(ctx->quads[ctx->numQuads++], &(s[i].quad));
+		}
+	}
 
-	++(ctx->numQuads);
+	ctx->sprites.count	= 0;
 }
 
 void
 renderer_end(gfx_context_t* ctx) {
+	draw_sprites(ctx);
 	flush(ctx);
+
+	if( ctx->instanced ) {
+		/* the divisors aren't part of the program, they would leak into the next draw */
+		vertex_attrib_divisor(ctx->attrRect, 0);
+		vertex_attrib_divisor(ctx->attrTexRect, 0);
+		vertex_attrib_divisor(ctx->attrInstColor, 0);
+
+		glDisableVertexAttribArray(ctx->attrCorner);
+		glDisableVertexAttribArray(ctx->attrRect);
+		glDisableVertexAttribArray(ctx->attrTexRect);
+		glDisableVertexAttribArray(ctx->attrInstColor);
+	} else {
+		glDisableVertexAttribArray(ctx->attrPosition);
+		glDisableVertexAttribArray(ctx->attrTexCoord);
+		glDisableVertexAttribArray(ctx->attrColor);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
 	glUseProgram(0);
 	glDepthMask(GL_TRUE);
 }
@@ -0,0 +1,183 @@
+/*
+** BoxWorld Copyright 2016(c) Wael El Oraiby. All Rights Reserved
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** Under Section 7 of GPL version 3, you are granted additional
+** permissions described in the GCC Runtime Library Exception, version
+** 3.1, as published by the Free Software Foundation.
+**
+** You should have received a copy of the GNU General Public License and
+** a copy of the GCC Runtime Library Exception along with this program;
+** see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+** <http://www.gnu.org/licenses/>.
+**
+*/
+#include "boxworld.h"
+
+/*
+ * packed positions. The floor squares are numbered in row order, which is
+ * also the order the box planes are scanned in, so the box numbers come out
+ * sorted without a sort. A snapshot is the player number followed by the box
+ * numbers, bits wide each, written from the low bit of the first word on.
+ * The unused high bits stay 0, so equal positions are equal words.
+ */
+
+bool
+snapshot_codec_init(snapshot_codec_t* c, const board_t* b, bool normalize) {
+	uint32	y, n	= 0;
+
+	memset(c, 0, sizeof(snapshot_codec_t));
+
+	c->number	= (uint16*)malloc(sizeof(uint16) * ((size_t)b->height * BOARD_STRIDE + BOARD_MAX_CELLS));
+	if( NULL == c->number ) {
+		boxworld_error(NOT_ENOUGH_MEMORY, "snapshot_codec_init: not enough memory");
+		return false;
+	}
+	c->pos	= c->number + (size_t)b->height * BOARD_STRIDE;
+
+	for( y = 0; y < b->height; ++y ) {
+		uint64	row	= b->floor[y];
+		while( row ) {
+			uint32	p	= board_pos((uint32)__builtin_ctzll(row), y);
+			c->number[p]	= (uint16)n;
+			c->pos[n++]		= (uint16)p;
+			row	&= row - 1;
+		}
+	}
+
+	c->squares		= n;
+	c->bits			= 1;
+	while( (1u << c->bits) < n ) {
+		++(c->bits);
+	}
+	c->box_count	= b->box_count;
+	c->words		= (uint32)(((uint64)(b->box_count + 1) * c->bits + 63) / 64);
+	c->normalize	= normalize;
+	return true;
+}
+
+void
+snapshot_codec_release(snapshot_codec_t* c) {
+	free(c->number);
+	memset(c, 0, sizeof(snapshot_codec_t));
+}
+
+static INLINE void
+put_bits(uint64* out, uint32 at, uint32 bits, uint32 v) {
+	uint32	w	= at >> 6;
+	uint32	s	= at & 63;
+
+	out[w]	|= (uint64)v << s;
+	if( s + bits > 64 ) {
+		out[w + 1]	|= (uint64)v >> (64 - s);
+	}
+}
+
+static INLINE uint32
+get_bits(const uint64* in, uint32 at, uint32 bits) {
+	uint32	w	= at >> 6;
+	uint32	s	= at & 63;
+	uint64	v	= in[w] >> s;
+
+	if( s + bits > 64 ) {
+		v	|= in[w + 1] << (64 - s);
+	}
+	return (uint32)v & ((1u << bits) - 1);
+}
+
+void
+snapshot_encode(const snapshot_codec_t* c, const board_t* b, uint64* out) {
+	uint64	reach[BOARD_MAX_HEIGHT];
+	uint32	player	= c->normalize ? board_reachable(b, b->player, reach) : b->player;
+	uint32	at		= c->bits;
+	uint32	y;
+
+	memset(out, 0, sizeof(uint64) * c->words);
+	put_bits(out, 0, c->bits, c->number[player]);
+
+	for( y = 0; y < b->height; ++y ) {
+		uint64	row	= b->boxes[y];
+		while( row ) {
+			put_bits(out, at, c->bits, c->number[board_pos((uint32)__builtin_ctzll(row), y)]);
+			at	+= c->bits;
+			row	&= row - 1;
+		}
+	}
+}
+
+bool
+snapshot_decode(const snapshot_codec_t* c, const uint64* in, board_t* b) {
+	uint32	player	= get_bits(in, 0, c->bits);
+	uint32	i, at, n, last	= 0;
+
+	/* checked first, so b is left alone when it fails */
+	for( i = 0, at = c->bits; i < c->box_count; ++i, at += c->bits ) {
+		n	= get_bits(in, at, c->bits);
+		if( n >= c->squares || (i > 0 && n <= last) || n == player ) {
+			boxworld_error(INVALID_FORMAT, "snapshot_decode: corrupted snapshot");
+			return false;
+		}
+		last	= n;
+	}
+
+	if( player >= c->squares ) {
+		boxworld_error(INVALID_FORMAT, "snapshot_decode: player off the floor");
+		return false;
+	}
+
+	memset(b->boxes, 0, sizeof(uint64) * b->height);
+	b->boxes_on_goal	= 0;
+
+	for( i = 0, at = c->bits; i < c->box_count; ++i, at += c->bits ) {
+		uint32	p	= c->pos[get_bits(in, at, c->bits)];
+		board_set(b->boxes, p);
+		b->boxes_on_goal	+= (uint32)board_test(b->goals, p);
+	}
+
+	b->player	= c->pos[player];
+	return true;
+}
+
+uint64
+snapshot_hash(const snapshot_codec_t* c, const uint64* s) {
+	uint64	h	= 0;
+	uint32	w;
+
+	for( w = 0; w < c->words; ++w ) {
+		h	= (h ^ s[w]) * 0x9E3779B97F4A7C15ull;
+		h	^= h >> 32;
+	}
+	h	= (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+	h	= (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+	return h ^ (h >> 31);
+}
+
+int
+snapshot_compare(const snapshot_codec_t* c, const uint64* a, const uint64* b) {
+	uint32	w;
+
+	for( w = 0; w < c->words; ++w ) {
+		if( a[w] != b[w] ) {
+			return a[w] < b[w] ? -1 : 1;
+		}
+	}
+	return 0;
+}
+
+bool
+game_restore(game_state_t* state, const snapshot_codec_t* c, const uint64* s) {
+	if( !snapshot_decode(c, s, &(state->board)) ) {
+		return false;
+	}
+
+	lower_bound_reset(&(state->bound), &(state->board));
+	state->log.count	= 0;
+	state->played		= 0;
+	state->last_move	= MOVE_NONE;
+	game_hash_normalize(state, state->normalize);		/* rehashes the new position */
+	return true;
+}
@@ -0,0 +1,540 @@
+/*
+** BoxWorld Copyright 2016(c) Wael El Oraiby. All Rights Reserved
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** Under Section 7 of GPL version 3, you are granted additional
+** permissions described in the GCC Runtime Library Exception, version
+** 3.1, as published by the Free Software Foundation.
+**
+** You should have received a copy of the GNU General Public License and
+** a copy of the GCC Runtime Library Exception along with this program;
+** see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+** <http://www.gnu.org/licenses/>.
+**
+*/
+#include "boxworld.h"
+
+/*
+ * A* over push states. A state is the sorted list of box positions plus the
+ * normalized player position (smallest square of the player region), hashed
+ * incrementally with zobrist keys. States live in a node pool, duplicates are
+ * detected through an open addressing transposition table; both are sized
+ * once from the memory budget.
+ */
+
+enum {
+	DIST_INF		= BOARD_DIST_INF,
+	MAX_F			= 0xFFFF,
+	H_MAX			= MAX_F - 1,	/* node h saturates there, the real sum is recomputed from the boxes */
+	NO_NODE			= SOLVER_NO_NODE,
+	CHECK_INTERVAL	= 256,		/* expansions between time/cancel checks */
+};
+
+typedef struct {
+	solver_link_t	link;
+	uint64			hash;
+	uint16			player;		/* normalized player position */
+	uint16			g;			/* pushes from the start */
+	uint16			h;			/* sum of the box distances to the nearest goal, H_MAX at most */
+	uint8			closed;
+} node_t;
+
+typedef struct {
+	uint64	hash;
+	uint32	node;		/* node index + 1, 0 is an empty slot */
+} tt_entry_t;
+
+/* open list entry, chained in per f buckets */
+typedef struct {
+	uint32	node;
+	uint32	next;
+} open_entry_t;
+
+typedef struct {
+	board_t		board;		/* scratch board, the boxes plane is rebuilt for every node */
+	uint32		box_count;
+	uint32		weight;
+	uint16		dist[BOARD_MAX_CELLS];
+
+	node_t*		nodes;
+	uint16*		boxes;		/* box_count sorted positions per node */
+	uint32		node_count;
+	uint32		node_max;
+
+	tt_entry_t*	table;
+	uint32		table_mask;
+
+	open_entry_t*	open;
+	uint32			open_count;		/* entries in the buckets */
+	uint32			open_used;		/* high water mark of the entry pool */
+	uint32			open_max;
+	uint32			open_free;		/* recycled entries */
+	uint32			min_f;
+	uint32			buckets[MAX_F + 1];
+
+	uint64		reach[BOARD_MAX_HEIGHT];
+	uint64		child_reach[BOARD_MAX_HEIGHT];
+} search_t;
+
+solver_params_t
+solver_default_params() {
+	solver_params_t	p;
+	p.memory_budget	= (size_t)256 << 20;
+	p.time_limit	= 0.0;
+	p.weight		= 1;
+	p.cancel		= NULL;
+	p.deadlocks		= NULL;
+	return p;
+}
+
+const char*
+solver_result_string(SOLVER_RESULT res) {
+	switch( res ) {
+	case SOLVER_SOLVED			: return "solved";
+	case SOLVER_UNSOLVABLE		: return "unsolvable";
+	case SOLVER_OUT_OF_MEMORY	: return "out of memory";
+	case SOLVER_TIMEOUT			: return "timeout";
+	case SOLVER_CANCELLED		: return "cancelled";
+	case SOLVER_INVALID			: return "invalid";
+	}
+	return "unknown";
+}
+
+/* h of a node whose sum didn't fit */
+static uint32
+boxes_h(const search_t* s, const uint16* boxes) {
+	uint32	h	= 0;
+	uint32	i;
+
+	for( i = 0; i < s->box_count; ++i ) {
+		h	+= s->dist[boxes[i]];
+	}
+	return h;
+}
+
+static uint32
+node_f(const search_t* s, const node_t* n) {
+	return MIN((uint32)n->g + s->weight * (uint32)n->h, (uint32)MAX_F);
+}
+
+/*
+ * the open list is a bucket per f value, each bucket is a LIFO so ties go
+ * to the most recently generated (deepest) nodes
+ */
+static bool
+open_push(search_t* s, uint32 node) {
+	uint32	f	= node_f(s, &(s->nodes[node]));
+	uint32	e;
+
+	if( s->open_free != NO_NODE ) {
+		e				= s->open_free;
+		s->open_free	= s->open[e].next;
+	} else if( s->open_used < s->open_max ) {
+		e	= s->open_used++;
+	} else {
+		return false;
+	}
+
+	s->open[e].node	= node;
+	s->open[e].next	= s->buckets[f];
+	s->buckets[f]	= e;
+	s->min_f		= MIN(s->min_f, f);
+	++(s->open_count);
+	return true;
+}
+
+/* pops a node from the lowest f bucket, the bucket is returned in f */
+static uint32
+open_pop(search_t* s, uint32* f) {
+	uint32	e;
+
+	while( NO_NODE == s->buckets[s->min_f] ) {
+		++(s->min_f);
+	}
+
+	e					= s->buckets[s->min_f];
+	s->buckets[s->min_f]	= s->open[e].next;
+	s->open[e].next		= s->open_free;
+	s->open_free		= e;
+	--(s->open_count);
+
+	*f	= s->min_f;
+	return s->open[e].node;
+}
+
+/* returns the table slot holding hash, or the empty slot where it belongs */
+static tt_entry_t*
+table_find(search_t* s, uint64 hash) {
+	uint32	i	= (uint32)hash & s->table_mask;
+	for( ;; ) {
+		tt_entry_t*	e	= &(s->table[i]);
+		if( 0 == e->node || e->hash == hash ) {
+			return e;
+		}
+		i	= (i + 1) & s->table_mask;
+	}
+}
+
+static bool
+search_allocate(search_t* s, size_t budget) {
+	/* the open list may hold a node twice when a shorter path to it is found */
+	size_t	per_node	= sizeof(node_t) + sizeof(uint16) * s->box_count + sizeof(open_entry_t) * 2;
+	size_t	entries		= 1024;
+	size_t	nodes;
+
+	/* a quarter of the budget goes to the table, the rest to nodes */
+	while( entries * 2 * sizeof(tt_entry_t) <= budget / 4 ) {
+		entries	<<= 1;
+	}
+
+	nodes	= (budget - MIN(budget, entries * sizeof(tt_entry_t))) / per_node;
+	nodes	= MIN(nodes, entries - entries / 4);	/* keep the load factor under 3/4 */
+	nodes	= MIN(nodes, (size_t)NO_NODE - 1);
+
+	if( nodes < 1 ) {
+		return false;
+	}
+
+	s->table		= (tt_entry_t*)calloc(entries, sizeof(tt_entry_t));
+	s->nodes		= (node_t*)malloc(sizeof(node_t) * nodes);
+	s->boxes		= (uint16*)malloc(sizeof(uint16) * MAX(s->box_count, 1) * nodes);
+	s->open			= (open_entry_t*)malloc(sizeof(open_entry_t) * nodes * 2);
+	s->open_max		= (uint32)MIN(nodes * 2, (size_t)NO_NODE - 1);
+	s->open_count	= 0;
+	s->open_used	= 0;
+	s->open_free	= NO_NODE;
+	s->min_f		= MAX_F;
+	s->table_mask	= (uint32)entries - 1;
+	s->node_max		= (uint32)nodes;
+	s->node_count	= 0;
+
+	memset(s->buckets, 0xFF, sizeof(s->buckets));
+
+	return s->table && s->nodes && s->boxes && s->open;
+}
+
+static void
+search_release(search_t* s) {
+	free(s->table);
+	free(s->nodes);
+	free(s->boxes);
+	free(s->open);
+	board_release(&(s->board));
+	free(s);
+}
+
+/* set the scratch board boxes plane from a node */
+static void
+load_boxes(search_t* s, uint32 node) {
+	const uint16*	boxes	= s->boxes + (size_t)node * s->box_count;
+	uint32			i;
+
+	memset(s->board.boxes, 0, sizeof(uint64) * s->board.height);
+	for( i = 0; i < s->box_count; ++i ) {
+		board_set(s->board.boxes, boxes[i]);
+	}
+}
+
+uint32
+solver_root_boxes(const board_t* b, const uint16* dist, uint16* boxes) {
+	uint32	h	= 0;
+	uint32	y, i;
+
+	bool	dead	= false;
+
+	for( y = 0, i = 0; y < b->height; ++y ) {
+		uint64	row	= b->boxes[y];
+		while( row ) {
+			uint32	pos	= board_pos((uint32)__builtin_ctzll(row), y);
+			boxes[i++]	= (uint16)pos;
+			h		+= dist[pos];
+			dead	|= DIST_INF == dist[pos];
+			row	&= row - 1;
+		}
+	}
+	return dead ? (uint32)SOLVER_DEAD : h;
+}
+
+void
+solver_move_box(const uint16* boxes, uint32 count, uint32 moved, uint32 to, uint16* out) {
+	uint32	k	= moved;
+
+	memcpy(out, boxes, sizeof(uint16) * count);
+	while( k > 0 && out[k - 1] > to ) {
+		out[k]	= out[k - 1];
+		--k;
+	}
+	while( k + 1 < count && out[k + 1] < to ) {
+		out[k]	= out[k + 1];
+		++k;
+	}
+	out[k]	= (uint16)to;
+}
+
+#define LINK(nodes, stride, n)	((const solver_link_t*)((const uint8*)(nodes) + (size_t)(n) * (stride)))
+
+bool
+solver_build_solution(const board_t* start, const void* nodes, size_t stride, uint32 goal, key_array_t* solution) {
+	board_t		b;
+	uint32*		pushes;
+	uint32		count	= 0;
+	uint32		n, i;
+	bool		ok		= true;
+
+	solution->count	= 0;
+
+	for( n = goal; LINK(nodes, stride, n)->parent != NO_NODE; n = LINK(nodes, stride, n)->parent ) {
+		++count;
+	}
+
+	pushes	= (uint32*)malloc(sizeof(uint32) * MAX(count, 1));
+	if( NULL == pushes || !board_allocate(&b, start->width, start->height) ) {
+		free(pushes);
+		return false;
+	}
+
+	board_copy(&b, start);
+
+	for( n = goal, i = count; i > 0; --i, n = LINK(nodes, stride, n)->parent ) {
+		pushes[i - 1]	= n;
+	}
+
+	for( i = 0; i < count && ok; ++i ) {
+		const solver_link_t*	l	= LINK(nodes, stride, pushes[i]);
+		ok	= board_push_keys(&b, l->push_from, (KEY)l->push_dir, solution);
+	}
+
+	board_release(&b);
+	free(pushes);
+	return ok;
+}
+
+#undef LINK
+
+static bool
+out_of_time(const solver_params_t* params, double start) {
+	if( params->cancel && *(params->cancel) ) {
+		return true;
+	}
+	return params->time_limit > 0.0 && boxworld_seconds() - start > params->time_limit;
+}
+
+SOLVER_RESULT
+solver_solve_board(const board_t* start, const solver_params_t* params, key_array_t* solution, solver_stats_t* stats) {
+	search_t*		s;
+	solver_stats_t	st;
+	double			t0		= boxworld_seconds();
+	uint32			goal	= NO_NODE;
+	uint32			root_h;
+	uint32			i;
+	node_t*			root;
+
+	memset(&st, 0, sizeof(solver_stats_t));
+	st.result	= SOLVER_UNSOLVABLE;
+
+	s	= (search_t*)malloc(sizeof(search_t));
+	if( NULL == s ) {
+		st.result	= SOLVER_OUT_OF_MEMORY;
+		goto done;
+	}
+
+	memset(s, 0, sizeof(search_t));
+	s->box_count	= start->box_count;
+	s->weight		= MAX(params->weight, 1);
+
+	if( !board_allocate(&(s->board), start->width, start->height) ) {
+		free(s);
+		st.result	= SOLVER_OUT_OF_MEMORY;
+		goto done;
+	}
+	board_copy(&(s->board), start);
+
+	if( !search_allocate(s, params->memory_budget) ) {
+		search_release(s);
+		st.result	= SOLVER_OUT_OF_MEMORY;
+		goto done;
+	}
+
+	board_push_distances(start, s->dist);
+
+	/* root node */
+	root		= &(s->nodes[0]);
+	root_h		= solver_root_boxes(start, s->dist, s->boxes);
+	root->h		= (uint16)MIN(root_h, (uint32)H_MAX);
+
+	root->player	= (uint16)board_reachable(&(s->board), start->player, s->reach);
+	root->hash		= board_boxes_hash(start) ^ zobrist_key(ZOBRIST_PLAYER, root->player);
+	root->g			= 0;
+	root->closed	= 0;
+	memset(&(root->link), 0, sizeof(solver_link_t));
+	root->link.parent	= NO_NODE;
+	s->node_count	= 1;
+
+	if( SOLVER_DEAD != root_h ) {
+		tt_entry_t*	e	= table_find(s, root->hash);
+		e->hash	= root->hash;
+		e->node	= 1;
+		open_push(s, 0);
+	}
+
+	while( s->open_count ) {
+		uint32		f;
+		uint32		index	= open_pop(s, &f);
+		node_t*		n		= &(s->nodes[index]);
+		uint16*		boxes;
+
+		/* stale entry, the node was reached again with fewer pushes */
+		if( n->closed || f != node_f(s, n) ) {
+			continue;
+		}
+
+		if( 0 == n->h ) {
+			goal		= index;
+			st.result	= SOLVER_SOLVED;
+			break;
+		}
+
+		n->closed	= 1;
+		++st.expanded;
+
+		if( 0 == (st.expanded % CHECK_INTERVAL) && out_of_time(params, t0) ) {
+			st.result	= (params->cancel && *(params->cancel)) ? SOLVER_CANCELLED : SOLVER_TIMEOUT;
+			break;
+		}
+
+		load_boxes(s, index);
+		board_reachable(&(s->board), n->player, s->reach);
+		boxes	= s->boxes + (size_t)index * s->box_count;
+
+		for( i = 0; i < s->box_count; ++i ) {
+			uint32	box	= boxes[i];
+			uint32	d;
+
+			for( d = 0; d < 4; ++d ) {
+				uint32			delta	= board_delta((KEY)d);
+				uint32			to		= box + delta;
+				uint32			player;
+				bool			deadlock;
+				uint64			hash;
+				uint16			g, h;
+				tt_entry_t*		e;
+				node_t*			c;
+				uint16*			cboxes;
+
+				if( !board_test(s->reach, box - delta) || !board_walkable(&(s->board), to) ||
+					board_test(s->board.boxes, to) || DIST_INF == s->dist[to] ) {
+					continue;
+				}
+
+				/* player region after the push */
+				board_clear(s->board.boxes, box);
+				board_set(s->board.boxes, to);
+				player	= board_reachable(&(s->board), box, s->child_reach);
+				deadlock	= params->deadlocks && deadlock_check(params->deadlocks, &(s->board), to, s->child_reach) != DEADLOCK_NONE;
+				board_clear(s->board.boxes, to);
+				board_set(s->board.boxes, box);
+
+				++st.generated;
+				if( deadlock ) {
+					continue;
+				}
+
+				hash	= n->hash ^ zobrist_key(ZOBRIST_PLAYER, n->player) ^ zobrist_key(ZOBRIST_PLAYER, player) ^
+						  zobrist_key(ZOBRIST_BOX, box) ^ zobrist_key(ZOBRIST_BOX, to);
+				g		= (uint16)(n->g + 1);
+				h		= (uint16)MIN((H_MAX == n->h ? boxes_h(s, boxes) : n->h) - s->dist[box] + s->dist[to], (uint32)H_MAX);
+
+				e	= table_find(s, hash);
+				if( e->node ) {
+					c	= &(s->nodes[e->node - 1]);
+					if( c->closed || c->g <= g ) {
+						continue;
+					}
+
+					/* shorter path to an open node, the old entry goes stale */
+					c->g			= g;
+					c->link.parent		= index;
+					c->link.push_from	= (uint16)box;
+					c->link.push_dir	= (uint8)d;
+					if( !open_push(s, e->node - 1) ) {
+						st.result	= SOLVER_OUT_OF_MEMORY;
+						goto finished;
+					}
+					continue;
+				}
+
+				if( s->node_count == s->node_max ) {
+					st.result	= SOLVER_OUT_OF_MEMORY;
+					goto finished;
+				}
+
+				c		= &(s->nodes[s->node_count]);
+				cboxes	= s->boxes + (size_t)s->node_count * s->box_count;
+
+				solver_move_box(boxes, s->box_count, i, to, cboxes);
+
+				c->hash				= hash;
+				c->player			= (uint16)player;
+				c->g				= g;
+				c->h				= h;
+				c->closed			= 0;
+				c->link.parent		= index;
+				c->link.push_from	= (uint16)box;
+				c->link.push_dir	= (uint8)d;
+				c->link.pad			= 0;
+
+				e->hash	= hash;
+				e->node	= s->node_count + 1;
+				if( !open_push(s, s->node_count) ) {
+					st.result	= SOLVER_OUT_OF_MEMORY;
+					goto finished;
+				}
+				++(s->node_count);
+			}
+		}
+	}
+
+finished:
+	/* what the search filled, one table entry per node, not the preallocated budget */
+	st.memory_used	= sizeof(search_t) +
+					  (size_t)s->node_count * (sizeof(node_t) + sizeof(uint16) * s->box_count + sizeof(tt_entry_t)) +
+					  (size_t)s->open_used * sizeof(open_entry_t);
+
+	if( SOLVER_SOLVED == st.result ) {
+		st.pushes	= s->nodes[goal].g;
+		if( solution && !solver_build_solution(start, s->nodes, sizeof(node_t), goal, solution) ) {
+			st.result	= SOLVER_OUT_OF_MEMORY;
+		}
+	}
+
+	search_release(s);
+
+done:
+	st.elapsed	= boxworld_seconds() - t0;
+	if( stats ) {
+		*stats	= st;
+	}
+	return st.result;
+}
+
+SOLVER_RESULT
+solver_solve(const level_t* lvl, const solver_params_t* params, key_array_t* solution, solver_stats_t* stats) {
+	board_t			b;
+	SOLVER_RESULT	res;
+
+	if( !board_from_level(&b, lvl) ) {
+		if( stats ) {
+			memset(stats, 0, sizeof(solver_stats_t));
+			stats->result	= SOLVER_INVALID;
+		}
+		return SOLVER_INVALID;
+	}
+
+	res	= solver_solve_board(&b, params, solution, stats);
+	board_release(&b);
+	return res;
+}
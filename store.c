@@ -0,0 +1,412 @@
+/*
+** BoxWorld Copyright 2016(c) Wael El Oraiby. All Rights Reserved
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** Under Section 7 of GPL version 3, you are granted additional
+** permissions described in the GCC Runtime Library Exception, version
+** 3.1, as published by the Free Software Foundation.
+**
+** You should have received a copy of the GNU General Public License and
+** a copy of the GCC Runtime Library Exception along with this program;
+** see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+** <http://www.gnu.org/licenses/>.
+**
+*/
+#include "boxworld.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * best solution store. Records are only ever appended to the log, the best
+ * record of every fingerprint is found through an open addressing table in a
+ * second file (path.idx). Both files are mapped, the index is only a cache:
+ * it remembers the log size it was built for and is rebuilt from the log
+ * when they disagree, e.g. after a crash between the two writes. A torn
+ * record at the end of the log is cut off on open.
+ */
+
+#define STORE_INDEX_MAGIC	"BWSI"
+
+enum {
+	INDEX_MIN_CAPACITY	= 1024,		/* slots, a power of two */
+	MAX_PATH_LENGTH		= 1024,
+};
+
+typedef struct {
+	char		magic[4];
+	uint32		version;
+	uint32		capacity;
+	uint32		used;
+	uint64		log_size;		/* log bytes indexed */
+} index_header_t;
+
+typedef struct {
+	uint64		fingerprint;	/* 0 is an empty slot */
+	uint64		offset;			/* of the best record in the log */
+} index_slot_t;
+
+struct solution_store_s {
+	int				log_fd;
+	int				index_fd;
+	const uint8*	log;
+	size_t			log_size;
+	index_header_t*	index;
+	size_t			index_size;
+	index_slot_t*	slots;
+};
+
+uint64
+level_fingerprint(const level_t* lvl) {
+	uint64	h	= 0xCBF29CE484222325ull;		/* FNV-1a over the size and a byte per cell */
+	uint32	c, count	= lvl->width * lvl->height;
+
+	h	= (h ^ lvl->width) * 0x100000001B3ull;
+	h	= (h ^ lvl->height) * 0x100000001B3ull;
+	for( c = 0; c < count; ++c ) {
+		h	= (h ^ (uint64)((lvl->cells[c].bg & 3) | ((lvl->cells[c].actor & 3) << 2))) * 0x100000001B3ull;
+	}
+
+	h	= (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+	h	= (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+	h	^= h >> 31;
+	return h ? h : 1;			/* 0 marks empty index slots */
+}
+
+static uint64
+record_size(uint32 key_count, uint32 data_size) {
+	return ((uint64)sizeof(store_record_t) + ((uint64)key_count + 3) / 4 + data_size + 7) & ~(uint64)7;
+}
+
+/* fewer pushes first, then fewer moves */
+static bool
+record_better(const store_record_t* a, const store_record_t* b) {
+	return a->pushes < b->pushes || (a->pushes == b->pushes && a->moves < b->moves);
+}
+
+static bool
+map_log(solution_store_t* s, size_t size) {
+	void*	data;
+
+	if( s->log ) {
+		munmap((void*)s->log, s->log_size);
+		s->log	= NULL;
+	}
+
+	data	= mmap(NULL, size, PROT_READ, MAP_SHARED, s->log_fd, 0);
+	if( MAP_FAILED == data ) {
+		s->log_size	= 0;
+		boxworld_error(LOAD_FAILED, "solution_store: unable to map the log");
+		return false;
+	}
+
+	s->log		= (const uint8*)data;
+	s->log_size	= size;
+	return true;
+}
+
+static index_slot_t*
+find_slot(const solution_store_t* s, uint64 fingerprint) {
+	uint32	mask	= s->index->capacity - 1;
+	uint32	i		= (uint32)fingerprint & mask;
+
+	while( s->slots[i].fingerprint && s->slots[i].fingerprint != fingerprint ) {
+		i	= (i + 1) & mask;
+	}
+	return &(s->slots[i]);
+}
+
+static void
+index_record(solution_store_t* s, uint64 offset) {
+	const store_record_t*	r		= (const store_record_t*)(s->log + offset);
+	index_slot_t*			slot	= find_slot(s, r->fingerprint);
+
+	if( 0 == slot->fingerprint ) {
+		slot->fingerprint	= r->fingerprint;
+		slot->offset		= offset;
+		++(s->index->used);
+	} else if( record_better(r, (const store_record_t*)(s->log + slot->offset)) ) {
+		slot->offset		= offset;
+	}
+}
+
+/* maps a fresh index of capacity slots and fills it from the log, returns the end of the last whole record */
+static uint64
+build_index(solution_store_t* s, uint32 capacity) {
+	size_t	size	= sizeof(index_header_t) + sizeof(index_slot_t) * (size_t)capacity;
+	uint64	offset	= sizeof(store_header_t);
+	void*	data;
+
+	if( s->index ) {
+		munmap(s->index, s->index_size);
+		s->index	= NULL;
+	}
+
+	if( 0 != ftruncate(s->index_fd, 0) || 0 != ftruncate(s->index_fd, (off_t)size) ) {
+		boxworld_error(LOAD_FAILED, "solution_store: unable to resize the index");
+		return 0;
+	}
+
+	data	= mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, s->index_fd, 0);
+	if( MAP_FAILED == data ) {
+		boxworld_error(LOAD_FAILED, "solution_store: unable to map the index");
+		return 0;
+	}
+
+	/* the file was truncated to 0 first, so every slot reads back empty */
+	s->index		= (index_header_t*)data;
+	s->index_size	= size;
+	s->slots		= (index_slot_t*)(s->index + 1);
+	memcpy(s->index->magic, STORE_INDEX_MAGIC, 4);
+	s->index->version	= STORE_VERSION;
+	s->index->capacity	= capacity;
+	s->index->used		= 0;
+
+	while( offset + sizeof(store_record_t) <= s->log_size ) {
+		const store_record_t*	r		= (const store_record_t*)(s->log + offset);
+		uint64					next	= offset + record_size(r->key_count, r->data_size);
+
+		if( next > s->log_size || 0 == r->fingerprint ) {
+			break;
+		}
+
+		if( s->index->used * 2 >= capacity ) {
+			return build_index(s, capacity * 2);
+		}
+
+		index_record(s, offset);
+		offset	= next;
+	}
+
+	s->index->log_size	= offset;
+	return offset;
+}
+
+static bool
+index_valid(const solution_store_t* s, const struct stat* st) {
+	const index_header_t*	hdr	= (const index_header_t*)s->index;
+
+	return (size_t)st->st_size >= sizeof(index_header_t) &&
+		   0 == memcmp(hdr->magic, STORE_INDEX_MAGIC, 4) &&
+		   hdr->version == STORE_VERSION &&
+		   hdr->capacity >= INDEX_MIN_CAPACITY && 0 == (hdr->capacity & (hdr->capacity - 1)) &&
+		   (size_t)st->st_size == sizeof(index_header_t) + sizeof(index_slot_t) * (size_t)hdr->capacity &&
+		   hdr->log_size == s->log_size;
+}
+
+solution_store_t*
+solution_store_open(const char* path) {
+	solution_store_t*	s;
+	struct stat			st;
+	char				index_path[MAX_PATH_LENGTH];
+	char				error_buff[MAX_ERROR_LENGTH]	= {0};
+	uint64				end;
+
+	if( strlen(path) + 5 > MAX_PATH_LENGTH ) {
+		return (solution_store_t*)boxworld_error(UNSUPPORTED, "solution_store_open: path is too long");
+	}
+	snprintf(index_path, MAX_PATH_LENGTH, "%s.idx", path);
+
+	s	= (solution_store_t*)calloc(1, sizeof(solution_store_t));
+	if( NULL == s ) {
+		return (solution_store_t*)boxworld_error(NOT_ENOUGH_MEMORY, "solution_store_open: not enough memory");
+	}
+
+	s->index_fd	= -1;
+	s->log_fd	= open(path, O_RDWR | O_CREAT, 0644);
+	if( s->log_fd < 0 || fstat(s->log_fd, &st) != 0 ) {
+		snprintf(error_buff, MAX_ERROR_LENGTH, "solution_store_open: unable to open %s", path);
+		boxworld_error(LOAD_FAILED, error_buff);
+		goto fail;
+	}
+
+	if( 0 == st.st_size ) {
+		store_header_t	hdr;
+
+		memcpy(hdr.magic, STORE_MAGIC, 4);
+		hdr.version	= STORE_VERSION;
+		if( (ssize_t)sizeof(store_header_t) != pwrite(s->log_fd, &hdr, sizeof(store_header_t), 0) ) {
+			snprintf(error_buff, MAX_ERROR_LENGTH, "solution_store_open: unable to write %s", path);
+			boxworld_error(LOAD_FAILED, error_buff);
+			goto fail;
+		}
+		st.st_size	= sizeof(store_header_t);
+	}
+
+	if( (size_t)st.st_size < sizeof(store_header_t) || !map_log(s, (size_t)st.st_size) ||
+		0 != memcmp(((const store_header_t*)s->log)->magic, STORE_MAGIC, 4) ||
+		((const store_header_t*)s->log)->version != STORE_VERSION ) {
+		snprintf(error_buff, MAX_ERROR_LENGTH, "solution_store_open: %s is not a solution store", path);
+		boxworld_error(INVALID_FORMAT, error_buff);
+		goto fail;
+	}
+
+	s->index_fd	= open(index_path, O_RDWR | O_CREAT, 0644);
+	if( s->index_fd < 0 || fstat(s->index_fd, &st) != 0 ) {
+		snprintf(error_buff, MAX_ERROR_LENGTH, "solution_store_open: unable to open %s", index_path);
+		boxworld_error(LOAD_FAILED, error_buff);
+		goto fail;
+	}
+
+	if( (size_t)st.st_size >= sizeof(index_header_t) ) {
+		void*	data	= mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, s->index_fd, 0);
+		if( MAP_FAILED != data ) {
+			s->index		= (index_header_t*)data;
+			s->index_size	= (size_t)st.st_size;
+			s->slots		= (index_slot_t*)(s->index + 1);
+		}
+	}
+
+	if( NULL == s->index || !index_valid(s, &st) ) {
+		end	= build_index(s, INDEX_MIN_CAPACITY);
+		if( 0 == end ) {
+			goto fail;
+		}
+
+		/* drop a torn tail so appends stay aligned with the index */
+		if( end < s->log_size && (0 != ftruncate(s->log_fd, (off_t)end) || !map_log(s, (size_t)end)) ) {
+			boxworld_error(LOAD_FAILED, "solution_store_open: unable to truncate the log");
+			goto fail;
+		}
+	}
+
+	return s;
+
+fail:
+	solution_store_close(s);
+	return NULL;
+}
+
+void
+solution_store_close(solution_store_t* s) {
+	if( s->log ) {
+		munmap((void*)s->log, s->log_size);
+	}
+	if( s->index ) {
+		munmap(s->index, s->index_size);
+	}
+	if( s->log_fd >= 0 ) {
+		close(s->log_fd);
+	}
+	if( s->index_fd >= 0 ) {
+		close(s->index_fd);
+	}
+	free(s);
+}
+
+uint32
+solution_store_count(const solution_store_t* s) {
+	return s->index->used;
+}
+
+const store_record_t*
+solution_store_find(const solution_store_t* s, uint64 fingerprint) {
+	const index_slot_t*	slot	= find_slot(s, fingerprint);
+	return slot->fingerprint ? (const store_record_t*)(s->log + slot->offset) : NULL;
+}
+
+bool
+solution_store_record(solution_store_t* s, const level_t* lvl, const key_array_t* keys, const void* data, uint32 data_size) {
+	store_record_t			rec;
+	const store_record_t*	best;
+	board_t					b;
+	uint8*					buff;
+	uint64					size;
+	size_t					k;
+
+	if( keys->count > 0xFFFFFFFF || !board_from_level(&b, lvl) ) {
+		return false;
+	}
+
+	/* only solutions that replay are stored */
+	rec.fingerprint	= level_fingerprint(lvl);
+	rec.pushes		= 0;
+	rec.moves		= (uint32)keys->count;
+	rec.key_count	= (uint32)keys->count;
+	rec.data_size	= data_size;
+
+	for( k = 0; k < keys->count && keys->array[k] <= KEY_LEFT; ++k ) {
+		uint32	step	= board_step(&b, keys->array[k]);
+		if( MOVE_NONE == step ) {
+			break;
+		}
+		rec.pushes	+= (step & MOVE_PUSH) ? 1 : 0;
+	}
+
+	if( k != keys->count || !board_solved(&b) ) {
+		board_release(&b);
+		boxworld_error(INVALID_FORMAT, "solution_store_record: the keys don't solve the level");
+		return false;
+	}
+	board_release(&b);
+
+	best	= solution_store_find(s, rec.fingerprint);
+	if( best && !record_better(&rec, best) ) {
+		return false;
+	}
+
+	size	= record_size(rec.key_count, data_size);
+	buff	= (uint8*)calloc(1, (size_t)size);
+	if( NULL == buff ) {
+		boxworld_error(NOT_ENOUGH_MEMORY, "solution_store_record: not enough memory");
+		return false;
+	}
+
+	memcpy(buff, &rec, sizeof(store_record_t));
+	for( k = 0; k < keys->count; ++k ) {
+		buff[sizeof(store_record_t) + (k >> 2)]	|= (uint8)(keys->array[k] << ((k & 3) << 1));
+	}
+	if( data_size ) {
+		memcpy(buff + sizeof(store_record_t) + (keys->count + 3) / 4, data, data_size);
+	}
+
+	if( (ssize_t)size != pwrite(s->log_fd, buff, (size_t)size, (off_t)s->log_size) ) {
+		free(buff);
+		/* cut a partial write off, the index still matches the old size */
+		if( 0 != ftruncate(s->log_fd, (off_t)s->log_size) ) {
+			s->index->log_size	= 0;
+		}
+		boxworld_error(LOAD_FAILED, "solution_store_record: unable to append to the log");
+		return false;
+	}
+	free(buff);
+
+	if( !map_log(s, s->log_size + (size_t)size) ) {
+		s->index->log_size	= 0;		/* forces a rebuild on the next open */
+		return false;
+	}
+
+	if( (s->index->used + 1) * 2 >= s->index->capacity ) {
+		return 0 != build_index(s, s->index->capacity * 2);
+	}
+
+	index_record(s, s->log_size - size);
+	s->index->log_size	= s->log_size;
+	return true;
+}
+
+void
+store_record_keys(const store_record_t* r, key_array_t* keys) {
+	const uint8*	packed	= (const uint8*)(r + 1);
+	uint32			k;
+
+	keys->count	= 0;
+	if( keys->max < r->key_count ) {
+		key_array_resize(keys, r->key_count);
+	}
+
+	for( k = 0; k < r->key_count; ++k ) {
+		keys->array[k]	= (KEY)((packed[k >> 2] >> ((k & 3) << 1)) & 3);
+	}
+	keys->count	= r->key_count;
+}
+
+const void*
+store_record_data(const store_record_t* r) {
+	return (const uint8*)(r + 1) + ((size_t)r->key_count + 3) / 4;
+}
@@ -0,0 +1,294 @@
+/*
+** BoxWorld Copyright 2016(c) Wael El Oraiby. All Rights Reserved
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** Under Section 7 of GPL version 3, you are granted additional
+** permissions described in the GCC Runtime Library Exception, version
+** 3.1, as published by the Free Software Foundation.
+**
+** You should have received a copy of the GNU General Public License and
+** a copy of the GCC Runtime Library Exception along with this program;
+** see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+** <http://www.gnu.org/licenses/>.
+**
+*/
+#include "boxworld.h"
+#include <pthread.h>
+#include <unistd.h>
+
+/*
+ * headless collection check: every level is validated, solved within a time
+ * and memory budget and its reference solution (if any) is replayed. Levels
+ * are checked concurrently, one level per worker at a time, and the results
+ * are written as CSV in level order.
+ */
+
+typedef enum {
+	REF_NONE,
+	REF_OK,
+	REF_NOT_SOLVED,
+	REF_ILLEGAL_MOVE,
+	REF_BAD_MOVE,
+} REFERENCE_RESULT;
+
+static const char*	reference_strings[]	= { "none", "ok", "not solved", "illegal move", "bad move" };
+
+typedef struct {
+	bool				valid;
+	uint32				boxes;
+	solver_stats_t		stats;
+	uint32				moves;			/* length of the solution found */
+	REFERENCE_RESULT	reference;
+	uint32				ref_moves;
+	uint32				ref_pushes;
+	char				error[128];
+} level_report_t;
+
+typedef struct {
+	const level_collection_t*	coll;
+	solver_params_t				params;
+	level_report_t*				reports;
+	volatile uint32				next;
+	solution_store_t*			store;			/* optional, gets every solution found */
+	pthread_mutex_t				store_lock;
+	uint32						stored;
+} verify_t;
+
+/* replays a LURD string on the board, see lurd_play */
+static REFERENCE_RESULT
+replay_reference(board_t* b, const char* moves, uint32* move_count, uint32* push_count) {
+	lurd_report_t	report;
+
+	lurd_play(b, moves, strlen(moves), &report);
+	*move_count	= report.moves;
+	*push_count	= report.pushes;
+
+	switch( report.result ) {
+	case LURD_SOLVED		: return REF_OK;
+	case LURD_NOT_SOLVED	: return REF_NOT_SOLVED;
+	case LURD_ILLEGAL_MOVE	: return REF_ILLEGAL_MOVE;
+	default					: return REF_BAD_MOVE;
+	}
+}
+
+static void
+verify_level(verify_t* v, uint32 index, key_array_t* keys) {
+	const level_t*	lvl		= &(v->coll->levels[index]);
+	const char*		ref		= v->coll->solutions[index];
+	level_report_t*	r		= &(v->reports[index]);
+	board_t			b;
+
+	memset(r, 0, sizeof(level_report_t));
+
+	if( !board_from_level(&b, lvl) ) {
+		snprintf(r->error, sizeof(r->error), "%s", boxworld_error_string());
+		r->stats.result	= SOLVER_INVALID;
+		return;
+	}
+
+	r->valid	= true;
+	r->boxes	= b.box_count;
+
+	if( ref ) {
+		board_t	rb;
+		if( board_allocate(&rb, b.width, b.height) ) {
+			board_copy(&rb, &b);
+			r->reference	= replay_reference(&rb, ref, &(r->ref_moves), &(r->ref_pushes));
+			board_release(&rb);
+		}
+	}
+
+	solver_solve_board(&b, &(v->params), keys, &(r->stats));
+	if( SOLVER_SOLVED == r->stats.result ) {
+		r->moves	= (uint32)keys->count;
+
+		if( v->store ) {
+			pthread_mutex_lock(&(v->store_lock));
+			v->stored	+= solution_store_record(v->store, lvl, keys, NULL, 0);
+			pthread_mutex_unlock(&(v->store_lock));
+		}
+	}
+
+	board_release(&b);
+}
+
+static void*
+verify_worker(void* arg) {
+	verify_t*	v		= (verify_t*)arg;
+	key_array_t	keys	= key_array_new();
+
+	for( ;; ) {
+		uint32	index	= __sync_fetch_and_add(&(v->next), 1);
+		if( index >= v->coll->count ) {
+			break;
+		}
+		verify_level(v, index, &keys);
+	}
+
+	key_array_release(&keys);
+	return NULL;
+}
+
+static void
+usage(const char* name) {
+	fprintf(stderr, "usage: %s [-j threads] [-t seconds] [-m MB] [-n] [-s store] <levels.sok> [report.csv]\n", name);
+	fprintf(stderr, "\t-j\tworker threads (default: one per core)\n");
+	fprintf(stderr, "\t-t\tsolver time limit per level (default: 10)\n");
+	fprintf(stderr, "\t-m\tsolver memory budget per level (default: 256)\n");
+	fprintf(stderr, "\t-n\tno freeze/corral deadlock pruning\n");
+	fprintf(stderr, "\t-s\tsolution store, the solutions found are kept when they beat the stored ones\n");
+}
+
+int
+main(int argc, char** argv) {
+	verify_t			v;
+	level_collection_t*	coll;
+	const char*			in_path		= NULL;
+	const char*			out_path	= NULL;
+	const char*			store_path	= NULL;
+	uint32				threads		= (uint32)sysconf(_SC_NPROCESSORS_ONLN);
+	bool				deadlocks	= true;
+	pthread_t*			workers;
+	FILE*				out;
+	double				start, elapsed;
+	uint64				expanded	= 0;
+	uint32				counts[SOLVER_INVALID + 1]	= {0};
+	uint32				ref_count	= 0;
+	uint32				ref_failed	= 0;
+	uint32				i;
+	int					a;
+
+	memset(&v, 0, sizeof(verify_t));
+	v.params			= solver_default_params();
+	v.params.time_limit	= 10.0;
+
+	for( a = 1; a < argc; ++a ) {
+		if( 0 == strcmp(argv[a], "-j") && a + 1 < argc ) {
+			threads	= (uint32)atoi(argv[++a]);
+		} else if( 0 == strcmp(argv[a], "-t") && a + 1 < argc ) {
+			v.params.time_limit	= atof(argv[++a]);
+		} else if( 0 == strcmp(argv[a], "-m") && a + 1 < argc ) {
+			v.params.memory_budget	= (size_t)atoi(argv[++a]) << 20;
+		} else if( 0 == strcmp(argv[a], "-n") ) {
+			deadlocks	= false;
+		} else if( 0 == strcmp(argv[a], "-s") && a + 1 < argc ) {
+			store_path	= argv[++a];
+		} else if( argv[a][0] == '-' && argv[a][1] != '\0' ) {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		} else if( NULL == in_path ) {
+			in_path		= argv[a];
+		} else if( NULL == out_path ) {
+			out_path	= argv[a];
+		} else {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if( NULL == in_path ) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	threads	= MAX(threads, 1);
+	start	= boxworld_seconds();
+
+	coll	= level_collection_load(in_path);
+	if( NULL == coll ) {
+		fprintf(stderr, "unable to read collection:\n%s\n", boxworld_error_string());
+		return EXIT_FAILURE;
+	}
+
+	out	= out_path ? fopen(out_path, "w") : stdout;
+	if( NULL == out ) {
+		fprintf(stderr, "unable to write %s\n", out_path);
+		level_collection_release(coll);
+		return EXIT_FAILURE;
+	}
+
+	/* the deadlock patterns are shared by all the levels and workers */
+	if( deadlocks ) {
+		v.params.deadlocks	= deadlock_cache_create(1 << 20);
+		if( NULL == v.params.deadlocks ) {
+			fprintf(stderr, "%s\n", boxworld_error_string());
+		}
+	}
+
+	if( store_path ) {
+		v.store	= solution_store_open(store_path);
+		if( NULL == v.store ) {
+			fprintf(stderr, "%s\n", boxworld_error_string());
+		}
+		pthread_mutex_init(&(v.store_lock), NULL);
+	}
+
+	v.coll		= coll;
+	v.reports	= (level_report_t*)malloc(sizeof(level_report_t) * MAX(coll->count, 1));
+	workers		= (pthread_t*)malloc(sizeof(pthread_t) * threads);
+	assert( NULL != v.reports && NULL != workers );
+
+	/* the calling thread is the first worker */
+	for( i = 1; i < threads; ++i ) {
+		if( 0 != pthread_create(&(workers[i]), NULL, verify_worker, &v) ) {
+			break;
+		}
+	}
+	threads	= i;
+	verify_worker(&v);
+	for( i = 1; i < threads; ++i ) {
+		pthread_join(workers[i], NULL);
+	}
+
+	elapsed	= boxworld_seconds() - start;
+
+	fprintf(out, "level,width,height,boxes,valid,result,expanded,generated,seconds,peak_memory,pushes,moves,reference,reference_moves,reference_pushes,error\n");
+	for( i = 0; i < coll->count; ++i ) {
+		const level_report_t*	r	= &(v.reports[i]);
+
+		fprintf(out, "%u,%u,%u,%u,%u,%s,%llu,%llu,%.6f,%llu,%u,%u,%s,%u,%u,\"%s\"\n",
+				i + 1, coll->levels[i].width, coll->levels[i].height, r->boxes, (uint32)r->valid,
+				solver_result_string(r->stats.result),
+				(unsigned long long)r->stats.expanded, (unsigned long long)r->stats.generated,
+				r->stats.elapsed, (unsigned long long)r->stats.memory_used,
+				r->stats.pushes, r->moves,
+				reference_strings[r->reference], r->ref_moves, r->ref_pushes, r->error);
+
+		++counts[r->stats.result];
+		expanded	+= r->stats.expanded;
+		if( r->reference != REF_NONE ) {
+			++ref_count;
+			ref_failed	+= (r->reference != REF_OK);
+		}
+	}
+
+	fprintf(stderr, "%s: %u levels, %u threads, %.3f s, %.1f levels/s, %.0f nodes/s\n",
+			in_path, coll->count, threads, elapsed,
+			(double)coll->count / MAX(elapsed, 1e-9), (double)expanded / MAX(elapsed, 1e-9));
+	fprintf(stderr, "%s: %u solved, %u unsolvable, %u out of memory, %u timeout, %u invalid\n",
+			in_path, counts[SOLVER_SOLVED], counts[SOLVER_UNSOLVABLE], counts[SOLVER_OUT_OF_MEMORY],
+			counts[SOLVER_TIMEOUT], counts[SOLVER_INVALID]);
+	fprintf(stderr, "%s: %u reference solutions, %u failed\n", in_path, ref_count, ref_failed);
+	if( v.store ) {
+		fprintf(stderr, "%s: %u solutions stored, %u levels in %s\n", in_path, v.stored, solution_store_count(v.store), store_path);
+		solution_store_close(v.store);
+	}
+	if( store_path ) {
+		pthread_mutex_destroy(&(v.store_lock));
+	}
+
+	if( out != stdout ) {
+		fclose(out);
+	}
+
+	free(workers);
+	free(v.reports);
+	deadlock_cache_release(v.params.deadlocks);
+	level_collection_release(coll);
+
+	return (counts[SOLVER_INVALID] || ref_failed) ? EXIT_FAILURE : EXIT_SUCCESS;
+}